@@ -117,12 +117,14 @@ public:
     };
 
     /* Prerequisite */
-    function<Command(DRAM<ALDRAM>*, Command cmd, int)> prereq[int(Level::MAX)][int(Command::MAX)];
+    typedef Command (*PrereqFunc)(DRAM<ALDRAM>*, Command cmd, int);
+    PrereqFunc prereq[int(Level::MAX)][int(Command::MAX)] = {};
 
     // SAUGATA: added function object container for row hit status
     /* Row hit */
-    function<bool(DRAM<ALDRAM>*, Command cmd, int)> rowhit[int(Level::MAX)][int(Command::MAX)];
-    function<bool(DRAM<ALDRAM>*, Command cmd, int)> rowopen[int(Level::MAX)][int(Command::MAX)];
+    typedef bool (*RowhitFunc)(DRAM<ALDRAM>*, Command cmd, int);
+    RowhitFunc rowhit[int(Level::MAX)][int(Command::MAX)] = {};
+    RowhitFunc rowopen[int(Level::MAX)][int(Command::MAX)] = {};
 
     /* Timing */
     struct TimingEntry
@@ -135,7 +137,8 @@ public:
     vector<TimingEntry> timing[int(Level::MAX)][int(Command::MAX)];
 
     /* Lambda */
-    function<void(DRAM<ALDRAM>*, int)> lambda[int(Level::MAX)][int(Command::MAX)];
+    typedef void (*LambdaFunc)(DRAM<ALDRAM>*, int);
+    LambdaFunc lambda[int(Level::MAX)][int(Command::MAX)] = {};
 
     /* Organization */
     enum class Org : int
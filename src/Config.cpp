@@ -1,5 +1,8 @@
 #include "Config.h"
 
+#include <climits>
+#include <cstdlib>
+
 using namespace std;
 using namespace ramulator;
 
@@ -54,10 +57,24 @@ void Config::parse(const string& fname)
           cpu_tick = atoi(tokens[1].c_str());
         } else if (tokens[0] == "mem_tick") {
           mem_tick = atoi(tokens[1].c_str());
+        } else if (tokens[0] == "channel_threads") {
+          channel_threads = atoi(tokens[1].c_str());
+        } else if (tokens[0] == "queue_depth") {
+          char* end;
+          long depth = strtol(tokens[1].c_str(), &end, 10);
+          if (*end || depth < 1 || depth > INT_MAX) {
+            cerr << "Bad queue_depth (expected a positive number): " << tokens[1] << endl;
+            exit(1);
+          }
+          queue_depth = depth;
         } else if (tokens[0] == "expected_limit_insts") {
           expected_limit_insts = atoi(tokens[1].c_str());
         } else if (tokens[0] == "warmup_insts") {
           warmup_insts = atoi(tokens[1].c_str());
+        } else if (tokens[0] == "trace_skip_insts") {
+          trace_skip_insts = atol(tokens[1].c_str());
+        } else if (tokens[0] == "epoch_cycles") {
+          epoch_cycles = atol(tokens[1].c_str());
         }
     }
     file.close();
@@ -20,9 +20,13 @@ private:
     int subarrays;
     int cpu_tick;
     int mem_tick;
+    int channel_threads = 1;
+    int queue_depth = 32;
     int core_num = 0;
     long expected_limit_insts = 0;
     long warmup_insts = 0;
+    long trace_skip_insts = 0;
+    long epoch_cycles = 0;
 
 public:
     Config() {}
@@ -59,9 +63,13 @@ public:
     int get_ranks() const {return ranks;}
     int get_cpu_tick() const {return cpu_tick;}
     int get_mem_tick() const {return mem_tick;}
+    int get_channel_threads() const {return channel_threads;}
+    int get_queue_depth() const {return queue_depth;}
     int get_core_num() const {return core_num;}
     long get_expected_limit_insts() const {return expected_limit_insts;}
     long get_warmup_insts() const {return warmup_insts;}
+    long get_trace_skip_insts() const {return trace_skip_insts;}
+    long get_epoch_cycles() const {return epoch_cycles;}
 
     bool has_l3_cache() const {
       if (options.find("cache") != options.end()) {
@@ -102,6 +110,56 @@ public:
       }
       return false;
     }
+    bool skip_idle_cycles() const {
+      // the default value is false
+      if (options.find("skip_idle_cycles") != options.end()) {
+        if ((options.find("skip_idle_cycles"))->second == "on") {
+          return true;
+        }
+        return false;
+      }
+      return false;
+    }
+    bool write_merging() const {
+      // the default value is false
+      if (options.find("write_merging") != options.end()) {
+        if ((options.find("write_merging"))->second == "on") {
+          return true;
+        }
+        return false;
+      }
+      return false;
+    }
+    bool trace_timestamps() const {
+      // the default value is false
+      if (options.find("trace_timestamps") != options.end()) {
+        if ((options.find("trace_timestamps"))->second == "on") {
+          return true;
+        }
+        return false;
+      }
+      return false;
+    }
+    bool trace_prefetch() const {
+      // the default value is false
+      if (options.find("trace_prefetch") != options.end()) {
+        if ((options.find("trace_prefetch"))->second == "on") {
+          return true;
+        }
+        return false;
+      }
+      return false;
+    }
+    bool cpu_epochs() const {
+      // the default value is false (memory cycles)
+      if (options.find("epoch_clock") != options.end()) {
+        if ((options.find("epoch_clock"))->second == "cpu") {
+          return true;
+        }
+        return false;
+      }
+      return false;
+    }
     bool print_cmd_trace() const {
       // the default value is false
       if (options.find("print_cmd_trace") != options.end()) {
@@ -8,7 +8,7 @@ using namespace ramulator;
 namespace ramulator
 {
 
-static vector<int> get_offending_subarray(DRAM<SALP>* channel, vector<int> & addr_vec){
+static AddrVec get_offending_subarray(DRAM<SALP>* channel, const AddrVec& addr_vec){
     int sa_id = 0;
     auto rank = channel->children[addr_vec[int(SALP::Level::Rank)]];
     auto bank = rank->children[addr_vec[int(SALP::Level::Bank)]];
@@ -18,7 +18,7 @@ static vector<int> get_offending_subarray(DRAM<SALP>* channel, vector<int> & add
             sa_id = sa_other->id;
             break;
         }
-    vector<int> offending = addr_vec;
+    AddrVec offending = addr_vec;
     offending[int(SALP::Level::SubArray)] = sa_id;
     offending[int(SALP::Level::Row)] = -1;
     return offending;
@@ -26,7 +26,7 @@ static vector<int> get_offending_subarray(DRAM<SALP>* channel, vector<int> & add
 
 
 template <>
-vector<int> Controller<SALP>::get_addr_vec(SALP::Command cmd, list<Request>::iterator req){
+AddrVec Controller<SALP>::get_addr_vec(SALP::Command cmd, SlabQueue::iterator req){
     if (cmd == SALP::Command::PRE_OTHER)
         return get_offending_subarray(channel, req->addr_vec);
     else
@@ -35,14 +35,13 @@ vector<int> Controller<SALP>::get_addr_vec(SALP::Command cmd, list<Request>::ite
 
 
 template <>
-bool Controller<SALP>::is_ready(list<Request>::iterator req){
-    SALP::Command cmd = get_first_cmd(req);
+long Controller<SALP>::get_next(SALP::Command cmd, SlabQueue::iterator req){
     if (cmd == SALP::Command::PRE_OTHER){
 
-        vector<int> addr_vec = get_offending_subarray(channel, req->addr_vec);
-        return channel->check(cmd, addr_vec.data(), clk);
+        AddrVec addr_vec = get_offending_subarray(channel, req->addr_vec);
+        return channel->get_next(cmd, addr_vec.data());
     }
-    else return channel->check(cmd, req->addr_vec.data(), clk);
+    else return channel->get_next(cmd, req->addr_vec.data());
 }
 
 template <>
@@ -51,12 +50,15 @@ void Controller<ALDRAM>::update_temp(ALDRAM::Temp current_temperature){
 }
 
 
+template <>
+bool Controller<TLDRAM>::counts_pending(){
+    return false;
+}
+
 template <>
 void Controller<TLDRAM>::tick(){
+    update_queue_lengths();
     clk++;
-    req_queue_length_sum += readq.size() + writeq.size();
-    read_req_queue_length_sum += readq.size();
-    write_req_queue_length_sum += writeq.size();
 
     /*** 1. Serve completed reads ***/
     if (pending.size()) {
@@ -67,7 +69,7 @@ void Controller<TLDRAM>::tick(){
                   channel->update_serving_requests(
                       req.addr_vec.data(), -1, clk);
           }
-            req.callback(req);
+            complete(req);
             pending.pop_front();
         }
     }
@@ -96,7 +98,7 @@ void Controller<TLDRAM>::tick(){
     if (req == queue->q.end() || !is_ready(req)) {
         // we couldn't find a command to schedule -- let's try to be speculative
         auto cmd = TLDRAM::Command::PRE;
-        vector<int> victim = rowpolicy->get_victim(cmd);
+        AddrVec victim = rowpolicy->get_victim(cmd);
         if (!victim.empty()){
             issue_cmd(cmd, victim);
         }
@@ -109,7 +111,6 @@ void Controller<TLDRAM>::tick(){
         if (req->type == Request::Type::READ || req->type == Request::Type::WRITE) {
           channel->update_serving_requests(req->addr_vec.data(), 1, clk);
         }
-        int tx = (channel->spec->prefetch_size * channel->spec->channel_width / 8);
         if (req->type == Request::Type::READ) {
             if (is_row_hit(req)) {
                 ++read_row_hits[coreid];
@@ -121,7 +122,7 @@ void Controller<TLDRAM>::tick(){
                 ++read_row_misses[coreid];
                 ++row_misses;
             }
-          read_transaction_bytes += tx;
+          read_transaction_bytes += tx_bytes;
         } else if (req->type == Request::Type::WRITE) {
           if (is_row_hit(req)) {
               ++write_row_hits[coreid];
@@ -133,13 +134,14 @@ void Controller<TLDRAM>::tick(){
               ++write_row_misses[coreid];
               ++row_misses;
           }
-          write_transaction_bytes += tx;
+          write_transaction_bytes += tx_bytes;
         }
     }
 
     /*** 5. Change a read request to a migration request ***/
     if (req->type == Request::Type::READ) {
         req->type = Request::Type::EXTENSION;
+        req->ready_epoch = -1;  // its first command has changed
     }
 
     // issue command on behalf of request
@@ -150,22 +152,31 @@ void Controller<TLDRAM>::tick(){
     if (cmd != channel->spec->translate[int(req->type)])
         return;
 
-    // set a future completion time for read requests
-    if (req->type == Request::Type::READ || req->type == Request::Type::EXTENSION) {
-        req->depart = clk + channel->spec->read_latency;
-        pending.push_back(*req);
-    }
     if (req->type == Request::Type::WRITE) {
         channel->update_serving_requests(req->addr_vec.data(), -1, clk);
     }
 
-    // remove request from queue
+    // remove request from queue; a read is moved out of it last
+    index(queue, *req, -1);
+
+    // set a future completion time for read requests
+    if (req->type == Request::Type::READ || req->type == Request::Type::EXTENSION) {
+        req->depart = clk + channel->spec->read_latency;
+        pending.push_back(move(*req));
+    }
     queue->q.erase(req);
 }
 
+template <>
+long Controller<TLDRAM>::get_next_event(){
+    // TLDRAM turns reads into migrations and uses its own write mode
+    // thresholds, so it is simply ticked every cycle
+    return clk + 1;
+}
+
 template<>
 void Controller<TLDRAM>::cmd_issue_autoprecharge(typename TLDRAM::Command& cmd,
-                                                    const vector<int>& addr_vec) {
+                                                    const AddrVec& addr_vec) {
     //TLDRAM currently does not have autoprecharge commands
     return;
 }
@@ -3,10 +3,11 @@
 
 #include <cassert>
 #include <cstdio>
+#include <cstdlib>
 #include <deque>
 #include <fstream>
-#include <list>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "Config.h"
@@ -14,6 +15,7 @@
 #include "Refresh.h"
 #include "Request.h"
 #include "Scheduler.h"
+#include "SlabQueue.h"
 #include "Statistics.h"
 
 #include "ALDRAM.h"
@@ -27,6 +29,32 @@ namespace ramulator
 
     extern bool warmup_complete;
 
+// Time-weighted sum of a queue's occupancy, as if it were sampled once per
+// cycle. The occupancy is only integrated when it changes; a change made at
+// cycle clk is first seen by the sample of cycle clk + 1.
+struct Occupancy {
+    long value = 0;  // current occupancy
+    long since = 1;  // first cycle sampled with the current occupancy
+    long sum = 0;    // samples taken before since
+
+    void set(long occupancy, long clk) {
+        if (occupancy == value)
+            return;
+        sum += value * (clk + 1 - since);
+        value = occupancy;
+        since = clk + 1;
+    }
+    // sum of the samples of cycles up to and including clk
+    long integral(long clk) const {
+        return sum + value * (clk + 1 - since);
+    }
+    // drop the samples of cycles up to and including clk
+    void restart(long clk) {
+        sum = 0;
+        since = clk + 1;
+    }
+};
+
 template <typename T>
 class Controller
 {
@@ -45,6 +73,8 @@ protected:
     VectorStat write_row_misses;
     VectorStat write_row_conflicts;
     ScalarStat useless_activates;
+    ScalarStat forwarded_reads;
+    ScalarStat merged_writes;
 
     ScalarStat read_latency_avg;
     ScalarStat read_latency_sum;
@@ -76,8 +106,9 @@ public:
     Refresh<T>* refresh;
 
     struct Queue {
-        list<Request> q;
+        SlabQueue q;
         unsigned int max = 32;
+        unordered_map<long, int> rows;  // number of requests per row, if track_rows
         unsigned int size() {return q.size();}
     };
 
@@ -91,9 +122,18 @@ public:
     Queue otherq;  // queue for all "other" requests (e.g., refresh)
 
     deque<Request> pending;  // read requests that are about to receive data from DRAM
+    bool defer_callbacks = false;  // when channels are ticked in parallel, completed reads
+    vector<Request> completed;     // are collected here and called back by Memory
     bool write_mode = false;  // whether write requests should be prioritized over reads
     float wr_high_watermark = 0.8f; // threshold for switching to write mode
     float wr_low_watermark = 0.2f; // threshold for switching back to read mode
+    bool write_merging = false;  // whether writes to a queued cache line are merged
+    unordered_map<long, int> write_addrs;  // number of requests in writeq per line() key
+    int tx_bytes;  // bytes per transaction, i.e., per cache line
+    bool track_rows = false;  // whether actq, readq and writeq count their requests per row
+    Occupancy readq_length;    // occupancy of readq, writeq and pending over time,
+    Occupancy writeq_length;   // brought up to date at the start of every tick
+    Occupancy pending_length;  // and skip
     //long refreshed = 0;  // last time refresh requests were generated
 
     /* Command trace for DRAMPower 3.1 */
@@ -114,6 +154,20 @@ public:
     {
         record_cmd_trace = configs.record_cmd_trace();
         print_cmd_trace = configs.print_cmd_trace();
+        readq.max = writeq.max = configs.get_queue_depth();
+        write_merging = configs.write_merging();
+        write_addrs.reserve(writeq.max);
+        tx_bytes = channel->spec->prefetch_size * channel->spec->channel_width / 8;
+        for (Queue* queue : {&actq, &readq, &writeq, &otherq})
+            queue->q.reserve(queue->max);
+        if (configs["scheduler"] != "")
+            scheduler->type = Scheduler<T>::parse_type(configs["scheduler"]);
+        if (configs["scheduler_cap"] != "")
+            scheduler->cap = atol(configs["scheduler_cap"].c_str());
+        if (configs["row_policy"] != "")
+            rowpolicy->type = RowPolicy<T>::parse_type(configs["row_policy"]);
+        track_rows = scheduler->type == Scheduler<T>::Type::FRFCFS_PriorHit
+            || rowpolicy->type == RowPolicy<T>::Type::ClosedAP;
         if (record_cmd_trace){
             if (configs["cmd_trace_prefix"] != "") {
               cmd_trace_prefix = configs["cmd_trace_prefix"];
@@ -186,6 +240,17 @@ public:
             .precision(0)
             ;
 
+        forwarded_reads
+            .name("forwarded_reads_"+to_string(channel->id))
+            .desc("Number of read requests served from the write queue")
+            .precision(0)
+            ;
+        merged_writes
+            .name("merged_writes_"+to_string(channel->id))
+            .desc("Number of write requests merged into a queued write to the same cache line")
+            .precision(0)
+            ;
+
         read_transaction_bytes
             .name("read_transaction_bytes_"+to_string(channel->id))
             .desc("The total byte of read transaction per channel")
@@ -291,8 +356,20 @@ public:
         cmd_trace_files.clear();
     }
 
+    // bring the queue length sums up to date with the integrated occupancy
+    void update_queue_stats() {
+      restart_queue_lengths();
+      long reads = readq_length.integral(clk);
+      if (counts_pending())
+        reads += pending_length.integral(clk);
+      read_req_queue_length_sum = reads;
+      write_req_queue_length_sum = writeq_length.integral(clk);
+      req_queue_length_sum = reads + write_req_queue_length_sum.value();
+    }
+
     void finish(long read_req, long dram_cycles) {
       read_latency_avg = read_latency_sum.value() / read_req;
+      update_queue_stats();
       req_queue_length_avg = req_queue_length_sum.value() / dram_cycles;
       read_req_queue_length_avg = read_req_queue_length_sum.value() / dram_cycles;
       write_req_queue_length_avg = write_req_queue_length_sum.value() / dram_cycles;
@@ -310,31 +387,91 @@ public:
         }
     }
 
+    // An accepted request is moved into the controller's queues
     bool enqueue(Request& req)
     {
+        // a write to a line that is already queued just updates the queued
+        // write, so it needs no slot of its own
+        if (write_merging && req.type == Request::Type::WRITE && write_addrs.count(line(req.addr))) {
+            ++merged_writes;
+            return true;
+        }
+
         Queue& queue = get_queue(req.type);
         if (queue.max == queue.size())
             return false;
 
         req.arrive = clk;
-        queue.q.push_back(req);
-        // shortcut for read requests, if a write to same addr exists
+        // shortcut for read requests, if a write to same line exists
         // necessary for coherence
-        if (req.type == Request::Type::READ && find_if(writeq.q.begin(), writeq.q.end(),
-                [req](Request& wreq){ return req.addr == wreq.addr;}) != writeq.q.end()){
+        if (req.type == Request::Type::READ && write_addrs.count(line(req.addr))) {
             req.depart = clk + 1;
-            pending.push_back(req);
-            readq.q.pop_back();
+            ++forwarded_reads;
+            pending.push_back(move(req));
+            return true;
         }
+        index(&queue, req, 1);
+        queue.q.push_back(move(req));
         return true;
     }
 
+    // The key of a queued write: its cache line with write merging, as
+    // requests carry their address unaligned, or else its exact address
+    long line(long addr) const
+    {
+        return write_merging ? addr / tx_bytes : addr;
+    }
+
+    // Account for a request that joins (delta = 1) or leaves (delta = -1) a queue
+    void index(Queue* queue, const Request& req, int delta)
+    {
+        if (queue == &writeq)
+            add_count(write_addrs, line(req.addr), delta);
+        if (track_rows && queue != &otherq)
+            add_count(queue->rows, row_key(req.addr_vec), delta);
+    }
+
+    // Number of requests in the queue of q that target the given row of the
+    // rowgroup that addr_vec selects (only counted if track_rows)
+    int get_row_reqs(SlabQueue& q, const AddrVec& addr_vec, int row)
+    {
+        for (Queue* queue : {&actq, &readq, &writeq}) {
+            if (&queue->q != &q)
+                continue;
+            auto count = queue->rows.find(row_key(addr_vec, row));
+            return count == queue->rows.end() ? 0 : count->second;
+        }
+        return 0;
+    }
+
+    void restart_queue_lengths()
+    {
+        if (warmup_complete && !queue_lengths_reset) {
+            // the stats were reset after warmup
+            readq_length.restart(clk);
+            writeq_length.restart(clk);
+            pending_length.restart(clk);
+            queue_lengths_reset = true;
+        }
+    }
+
+    // Record the queue occupancy left by the last cycle (and by the requests
+    // enqueued since) for the cycles from clk + 1 on
+    void update_queue_lengths()
+    {
+        restart_queue_lengths();
+        readq_length.set(readq.size(), clk);
+        writeq_length.set(writeq.size(), clk);
+        pending_length.set(pending.size(), clk);
+    }
+
+    // whether the request queue length stats include pending reads
+    bool counts_pending() {return true;}
+
     void tick()
     {
+        update_queue_lengths();
         clk++;
-        req_queue_length_sum += readq.size() + writeq.size() + pending.size();
-        read_req_queue_length_sum += readq.size() + pending.size();
-        write_req_queue_length_sum += writeq.size();
 
         /*** 1. Serve completed reads ***/
         if (pending.size()) {
@@ -345,7 +482,7 @@ public:
                   channel->update_serving_requests(
                       req.addr_vec.data(), -1, clk);
                 }
-                req.callback(req);
+                complete(req);
                 pending.pop_front();
             }
         }
@@ -354,16 +491,7 @@ public:
         refresh->tick_ref();
 
         /*** 3. Should we schedule writes? ***/
-        if (!write_mode) {
-            // yes -- write queue is almost full or read queue is empty
-            if (writeq.size() > int(wr_high_watermark * writeq.max) || readq.size() == 0)
-                write_mode = true;
-        }
-        else {
-            // no -- write queue is almost empty and read queue is not empty
-            if (writeq.size() < int(wr_low_watermark * writeq.max) && readq.size() != 0)
-                write_mode = false;
-        }
+        write_mode = next_write_mode();
 
         /*** 4. Find the best command to schedule, if any ***/
 
@@ -399,7 +527,7 @@ public:
         if (!is_valid_req) {
             // we couldn't find a command to schedule -- let's try to be speculative
             auto cmd = T::Command::PRE;
-            vector<int> victim = rowpolicy->get_victim(cmd);
+            AddrVec victim = rowpolicy->get_victim(cmd);
             if (!victim.empty()){
                 issue_cmd(cmd, victim);
             }
@@ -412,7 +540,6 @@ public:
             if (req->type == Request::Type::READ || req->type == Request::Type::WRITE) {
               channel->update_serving_requests(req->addr_vec.data(), 1, clk);
             }
-            int tx = (channel->spec->prefetch_size * channel->spec->channel_width / 8);
             if (req->type == Request::Type::READ) {
                 if (is_row_hit(req)) {
                     ++read_row_hits[coreid];
@@ -424,7 +551,7 @@ public:
                     ++read_row_misses[coreid];
                     ++row_misses;
                 }
-              read_transaction_bytes += tx;
+              read_transaction_bytes += tx_bytes;
             } else if (req->type == Request::Type::WRITE) {
               if (is_row_hit(req)) {
                   ++write_row_hits[coreid];
@@ -436,7 +563,7 @@ public:
                   ++write_row_misses[coreid];
                   ++row_misses;
               }
-              write_transaction_bytes += tx;
+              write_transaction_bytes += tx_bytes;
             }
         }
 
@@ -448,59 +575,93 @@ public:
         if (cmd != channel->spec->translate[int(req->type)]) {
             if(channel->spec->is_opening(cmd)) {
                 // promote the request that caused issuing activation to actq
-                actq.q.push_back(*req);
-                queue->q.erase(req);
+                index(queue, *req, -1);
+                index(&actq, *req, 1);
+                actq.q.splice_back(queue->q, req);
             }
 
             return;
         }
 
+        if (req->type == Request::Type::WRITE) {
+            channel->update_serving_requests(req->addr_vec.data(), -1, clk);
+            // req->callback(*req);
+        }
+
+        // remove request from queue; a read is moved out of it last
+        index(queue, *req, -1);
+
         // set a future completion time for read requests
         if (req->type == Request::Type::READ) {
             req->depart = clk + channel->spec->read_latency;
-            pending.push_back(*req);
+            pending.push_back(move(*req));
         }
+        queue->q.erase(req);
+    }
 
-        if (req->type == Request::Type::WRITE) {
-            channel->update_serving_requests(req->addr_vec.data(), -1, clk);
-            // req->callback(*req);
+    // Return the earliest clock at which tick() may do more than accumulate
+    // per-cycle statistics (i.e., serve a read, inject a refresh, switch the
+    // write mode or issue a command). Until then, the controller can be
+    // fast-forwarded with skip().
+    long get_next_event()
+    {
+        if (next_write_mode() != write_mode)
+            return clk + 1;
+
+        long next_clk = refresh->get_next_refresh();
+        if (pending.size())
+            next_clk = min(next_clk, pending[0].depart);
+
+        for (Queue* queue : {&actq, &readq, &writeq, &otherq}) {
+            for (auto req = queue->q.begin(); req != queue->q.end(); ++req) {
+                if (next_clk <= clk + 1)
+                    return clk + 1; // cannot get any earlier
+                next_clk = min(next_clk, get_ready_clk(req));
+            }
         }
 
-        // remove request from queue
-        queue->q.erase(req);
+        next_clk = min(next_clk, rowpolicy->get_next_victim_clk(T::Command::PRE));
+        return max(next_clk, clk + 1);
+    }
+
+    // Fast-forward over idle cycles, as reported by get_next_event()
+    void skip(long cycles)
+    {
+        update_queue_lengths();
+        clk += cycles;
+        refresh->skip(cycles);
     }
 
-    bool is_ready(list<Request>::iterator req)
+    bool is_ready(SlabQueue::iterator req)
     {
-        typename T::Command cmd = get_first_cmd(req);
-        return channel->check(cmd, req->addr_vec.data(), clk);
+        return get_ready_clk(req) <= clk;
     }
 
-    bool is_ready(typename T::Command cmd, const vector<int>& addr_vec)
+    bool is_ready(typename T::Command cmd, const AddrVec& addr_vec)
     {
         return channel->check(cmd, addr_vec.data(), clk);
     }
 
-    bool is_row_hit(list<Request>::iterator req)
+    bool is_row_hit(SlabQueue::iterator req)
     {
         // cmd must be decided by the request type, not the first cmd
         typename T::Command cmd = channel->spec->translate[int(req->type)];
         return channel->check_row_hit(cmd, req->addr_vec.data());
     }
 
-    bool is_row_hit(typename T::Command cmd, const vector<int>& addr_vec)
+    bool is_row_hit(typename T::Command cmd, const AddrVec& addr_vec)
     {
         return channel->check_row_hit(cmd, addr_vec.data());
     }
 
-    bool is_row_open(list<Request>::iterator req)
+    bool is_row_open(SlabQueue::iterator req)
     {
         // cmd must be decided by the request type, not the first cmd
         typename T::Command cmd = channel->spec->translate[int(req->type)];
         return channel->check_row_open(cmd, req->addr_vec.data());
     }
 
-    bool is_row_open(typename T::Command cmd, const vector<int>& addr_vec)
+    bool is_row_open(typename T::Command cmd, const AddrVec& addr_vec)
     {
         return channel->check_row_open(cmd, addr_vec.data());
     }
@@ -539,46 +700,88 @@ public:
     }
 
 private:
-    typename T::Command get_first_cmd(list<Request>::iterator req)
+    long row_key(const AddrVec& addr_vec, int row)
+    {
+        return long(rowtable->get_id(addr_vec)) * channel->spec->org_entry.count[int(T::Level::Row)] + row;
+    }
+    long row_key(const AddrVec& addr_vec)
+    {
+        return row_key(addr_vec, addr_vec[int(T::Level::Row)]);
+    }
+
+    static void add_count(unordered_map<long, int>& counts, long key, int delta)
+    {
+        if ((counts[key] += delta) == 0)
+            counts.erase(key);
+    }
+
+    long epoch = 0;  // bumped whenever a command changes the state of the channel
+    bool queue_lengths_reset = false;  // whether the occupancies were restarted after warmup
+
+    void complete(Request& req)
+    {
+        if (defer_callbacks)
+            completed.push_back(req);
+        else
+            req.callback(req);
+    }
+
+    typename T::Command get_first_cmd(SlabQueue::iterator req)
+    {
+        update_ready(req);
+        return typename T::Command(req->first_cmd);
+    }
+
+    // the earliest clock when the first command of a request becomes ready
+    long get_ready_clk(SlabQueue::iterator req)
     {
+        update_ready(req);
+        return req->ready_clk;
+    }
+
+    // Decode the first command of a request and find when it becomes ready.
+    // Both only change when a command is issued to the channel, so they are
+    // cached in the request and recomputed once per epoch at most.
+    void update_ready(SlabQueue::iterator req)
+    {
+        if (req->ready_epoch == epoch)
+            return;
         typename T::Command cmd = channel->spec->translate[int(req->type)];
-        return channel->decode(cmd, req->addr_vec.data());
+        cmd = channel->decode(cmd, req->addr_vec.data());
+        req->first_cmd = int(cmd);
+        req->ready_clk = get_next(cmd, req);
+        req->ready_epoch = epoch;
+    }
+
+    long get_next(typename T::Command cmd, SlabQueue::iterator req)
+    {
+        return channel->get_next(cmd, req->addr_vec.data());
+    }
+
+    bool next_write_mode()
+    {
+        if (!write_mode) {
+            // yes -- write queue is almost full or read queue is empty
+            return writeq.size() > int(wr_high_watermark * writeq.max) || readq.size() == 0;
+        }
+        // no -- write queue is almost empty and read queue is not empty
+        return !(writeq.size() < int(wr_low_watermark * writeq.max) && readq.size() != 0);
     }
 
     // upgrade to an autoprecharge command
     void cmd_issue_autoprecharge(typename T::Command& cmd,
-                                            const vector<int>& addr_vec) {
+                                            const AddrVec& addr_vec) {
 
         // currently, autoprecharge is only used with closed row policy
         if(channel->spec->is_accessing(cmd) && rowpolicy->type == RowPolicy<T>::Type::ClosedAP) {
             // check if it is the last request to the opened row
+            // (the row is open, so every request that targets it is a hit)
             Queue* queue = write_mode ? &writeq : &readq;
+            int row = addr_vec[int(T::Level::Row)];
 
-            auto begin = addr_vec.begin();
-            vector<int> rowgroup(begin, begin + int(T::Level::Row) + 1);
-
-			int num_row_hits = 0;
-
-            for (auto itr = queue->q.begin(); itr != queue->q.end(); ++itr) {
-                if (is_row_hit(itr)) { 
-                    auto begin2 = itr->addr_vec.begin();
-                    vector<int> rowgroup2(begin2, begin2 + int(T::Level::Row) + 1);
-                    if(rowgroup == rowgroup2)
-                        num_row_hits++;
-                }
-            }
-
-            if(num_row_hits == 0) {
-                Queue* queue = &actq;
-                for (auto itr = queue->q.begin(); itr != queue->q.end(); ++itr) {
-                    if (is_row_hit(itr)) {
-                        auto begin2 = itr->addr_vec.begin();
-                        vector<int> rowgroup2(begin2, begin2 + int(T::Level::Row) + 1);
-                        if(rowgroup == rowgroup2)
-                            num_row_hits++;
-                    }
-                }
-            }
+            int num_row_hits = get_row_reqs(queue->q, addr_vec, row);
+            if(num_row_hits == 0)
+                num_row_hits = get_row_reqs(actq.q, addr_vec, row);
 
             assert(num_row_hits > 0); // The current request should be a hit, 
                                       // so there should be at least one request 
@@ -595,11 +798,12 @@ private:
 
     }
 
-    void issue_cmd(typename T::Command cmd, const vector<int>& addr_vec)
+    void issue_cmd(typename T::Command cmd, const AddrVec& addr_vec)
     {
         cmd_issue_autoprecharge(cmd, addr_vec);
         assert(is_ready(cmd, addr_vec));
         channel->update(cmd, addr_vec.data(), clk);
+        epoch++;
 
         if(cmd == T::Command::PRE){
             if(rowtable->get_hits(addr_vec, true) == 0){
@@ -630,17 +834,17 @@ private:
             printf("\n");
         }
     }
-    vector<int> get_addr_vec(typename T::Command cmd, list<Request>::iterator req){
+    AddrVec get_addr_vec(typename T::Command cmd, SlabQueue::iterator req){
         return req->addr_vec;
     }
 };
 
 template <>
-vector<int> Controller<SALP>::get_addr_vec(
-    SALP::Command cmd, list<Request>::iterator req);
+AddrVec Controller<SALP>::get_addr_vec(
+    SALP::Command cmd, SlabQueue::iterator req);
 
 template <>
-bool Controller<SALP>::is_ready(list<Request>::iterator req);
+long Controller<SALP>::get_next(SALP::Command cmd, SlabQueue::iterator req);
 
 template <>
 void Controller<ALDRAM>::update_temp(ALDRAM::Temp current_temperature);
@@ -648,9 +852,15 @@ void Controller<ALDRAM>::update_temp(ALDRAM::Temp current_temperature);
 template <>
 void Controller<TLDRAM>::tick();
 
+template <>
+bool Controller<TLDRAM>::counts_pending();
+
+template <>
+long Controller<TLDRAM>::get_next_event();
+
 template <>
 void Controller<TLDRAM>::cmd_issue_autoprecharge(typename TLDRAM::Command& cmd,
-                                                    const vector<int>& addr_vec);
+                                                    const AddrVec& addr_vec);
 
 } /*namespace ramulator*/
 
@@ -115,12 +115,14 @@ public:
     };
 
     /* Prerequisite */
-    function<Command(DRAM<DDR3>*, Command cmd, int)> prereq[int(Level::MAX)][int(Command::MAX)];
+    typedef Command (*PrereqFunc)(DRAM<DDR3>*, Command cmd, int);
+    PrereqFunc prereq[int(Level::MAX)][int(Command::MAX)] = {};
 
     // SAUGATA: added function object container for row hit status
     /* Row hit */
-    function<bool(DRAM<DDR3>*, Command cmd, int)> rowhit[int(Level::MAX)][int(Command::MAX)];
-    function<bool(DRAM<DDR3>*, Command cmd, int)> rowopen[int(Level::MAX)][int(Command::MAX)];
+    typedef bool (*RowhitFunc)(DRAM<DDR3>*, Command cmd, int);
+    RowhitFunc rowhit[int(Level::MAX)][int(Command::MAX)] = {};
+    RowhitFunc rowopen[int(Level::MAX)][int(Command::MAX)] = {};
 
     /* Timing */
     struct TimingEntry
@@ -133,7 +135,8 @@ public:
     vector<TimingEntry> timing[int(Level::MAX)][int(Command::MAX)];
 
     /* Lambda */
-    function<void(DRAM<DDR3>*, int)> lambda[int(Level::MAX)][int(Command::MAX)];
+    typedef void (*LambdaFunc)(DRAM<DDR3>*, int);
+    LambdaFunc lambda[int(Level::MAX)][int(Command::MAX)] = {};
 
     /* Organization */
     enum class Org : int
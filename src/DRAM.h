@@ -4,11 +4,11 @@
 #include "Statistics.h"
 #include <iostream>
 #include <vector>
-#include <deque>
 #include <map>
 #include <functional>
 #include <algorithm>
 #include <cassert>
+#include <memory>
 #include <type_traits>
 
 using namespace std;
@@ -16,6 +16,79 @@ using namespace std;
 namespace ramulator
 {
 
+// Rows of a bank (or an equivalent entity) that are in a non-default state.
+// Only a handful of rows are ever open at once, so they are kept in a small
+// array with the interface of a map from row id to state.
+template <typename State>
+class RowState
+{
+public:
+    typedef pair<int, State> value_type;
+    typedef typename vector<value_type>::iterator iterator;
+
+    iterator begin() {return rows.begin();}
+    iterator end() {return rows.end();}
+    size_t size() const {return rows.size();}
+    bool empty() const {return rows.empty();}
+    void clear() {rows.clear();}
+
+    iterator find(int row)
+    {
+        return find_if(rows.begin(), rows.end(),
+                [row](const value_type& kv) {return kv.first == row;});
+    }
+
+    State& operator[](int row)
+    {
+        auto itr = find(row);
+        if (itr != rows.end())
+            return itr->second;
+        rows.emplace_back(row, State());
+        return rows.back().second;
+    }
+
+    size_t erase(int row)
+    {
+        auto itr = find(row);
+        if (itr == rows.end())
+            return 0;
+        rows.erase(itr);
+        return 1;
+    }
+
+private:
+    vector<value_type> rows;
+};
+
+// Timing state of all nodes of one level of a channel. The nodes of a level
+// are numbered in address order, so the children of a node (and thus the
+// siblings of a target) are a contiguous range, and each array holds the
+// values of all nodes of the level for one command after another.
+template <typename T>
+struct DRAMLevel
+{
+    int nodes = 0;   // nodes of this level in the channel
+    int fanout = 0;  // children of each node (0 if they are not instantiated)
+
+    // the earliest time in the future when a command could be ready, at
+    // next[cmd * nodes + node]
+    vector<long> next;
+
+    // The most recent history of when commands were issued. Every node has a
+    // ring buffer of dist[cmd] clocks per command, newest first from its head.
+    // The buffers of a command are adjacent, from hist_begin[cmd].
+    int dist[int(T::Command::MAX)];
+    long hist_begin[int(T::Command::MAX)];
+    vector<long> hist;
+    vector<int> head;  // head[cmd * nodes + node]
+
+    // Whether a command has timing parameters for the siblings of its target
+    // at this level. If not, update_timing() skips the siblings.
+    bool sibling_timing[int(T::Command::MAX)];
+
+    long* next_of(typename T::Command cmd) {return next.data() + long(cmd) * nodes;}
+};
+
 template <typename T>
 class DRAM
 {
@@ -28,7 +101,8 @@ public:
     ScalarStat serving_requests;
     ScalarStat average_serving_requests;
 
-    // Constructor
+    // Constructor: builds the tree under a node of the given level, which
+    // becomes its root
     DRAM(T* spec, typename T::Level level);
     ~DRAM();
 
@@ -48,10 +122,7 @@ public:
     // State of Rows:
     // There are too many rows for them to be instantiated individually
     // Instead, their bank (or an equivalent entity) tracks their state for them
-    map<int, typename T::State> row_state;
-
-    // Insert a node as one of my child nodes
-    void insert(DRAM<T>* child);
+    RowState<typename T::State> row_state;
 
     // Decode a command into its "prerequisite" command (if any is needed)
     typename T::Command decode(typename T::Command cmd, const int* addr);
@@ -90,35 +161,40 @@ public:
     void finish(long dram_cycles);
 
 private:
-    // Constructor
-    DRAM(){}
+    // Constructor of a node below the root
+    DRAM(T* spec, typename T::Level level, shared_ptr<vector<DRAMLevel<T>>> levels, int index);
 
     // Timing
     long cur_clk = 0;
-    long next[int(T::Command::MAX)]; // the earliest time in the future when a command could be ready
-    deque<long> prev[int(T::Command::MAX)]; // the most recent history of when commands were issued
+
+    // The timing state of every level of the tree, shared by all its nodes,
+    // and my position in my level
+    shared_ptr<vector<DRAMLevel<T>>> levels;
+    int index;
 
     // Lookup table for which commands must be preceded by which other commands (i.e., "prerequisite")
     // E.g., a read command to a closed bank must be preceded by an activate command
-    function<typename T::Command(DRAM<T>*, typename T::Command cmd, int)>* prereq;
+    typename T::PrereqFunc* prereq;
 
     // SAUGATA: added table for row hits
     // Lookup table for whether a command is a row hit
     // E.g., a read command to a closed bank must be preceded by an activate command
-    function<bool(DRAM<T>*, typename T::Command cmd, int)>* rowhit;
-    function<bool(DRAM<T>*, typename T::Command cmd, int)>* rowopen;
+    typename T::RowhitFunc* rowhit;
+    typename T::RowhitFunc* rowopen;
 
     // Lookup table between commands and the state transitions they trigger
     // E.g., an activate command to a closed bank opens both the bank and the row
-    function<void(DRAM<T>*, int)>* lambda;
+    typename T::LambdaFunc* lambda;
 
     // Lookup table for timing parameters
     // E.g., activate->precharge: tRAS@bank, activate->activate: tRC@bank
     vector<typename T::TimingEntry>* timing;
 
     // Helper Functions
+    void init(typename T::Level level);
     void update_state(typename T::Command cmd, const int* addr);
     void update_timing(typename T::Command cmd, const int* addr, long clk);
+    void update_refresh(typename T::Command cmd, typename T::Command next_cmd, long past, long clk);
 }; /* class DRAM */
 
 
@@ -188,9 +264,49 @@ void DRAM<T>::finish(long dram_cycles) {
 // Constructor
 template <typename T>
 DRAM<T>::DRAM(T* spec, typename T::Level level) :
-    spec(spec), level(level), id(0), parent(NULL)
+    spec(spec), level(level), id(0), parent(NULL), levels(new vector<DRAMLevel<T>>(int(T::Level::MAX))), index(0)
+{
+    // lay out the timing state of every level that has nodes
+    int nodes = 1;
+    for (int l = int(level); l < int(T::Level::Row); l++) {
+        DRAMLevel<T>& lvl = (*levels)[l];
+        lvl.nodes = nodes;
+
+        long history = 0;
+        for (int cmd = 0; cmd < int(T::Command::MAX); cmd++) {
+            lvl.dist[cmd] = 0;
+            lvl.sibling_timing[cmd] = false;
+            for (auto& t : spec->timing[l][cmd]) {
+                lvl.dist[cmd] = max(lvl.dist[cmd], t.dist);
+                lvl.sibling_timing[cmd] |= t.sibling;
+            }
+            lvl.hist_begin[cmd] = history;
+            history += long(lvl.dist[cmd]) * nodes;
+        }
+        lvl.next.assign(long(T::Command::MAX) * nodes, -1); // initialize future
+        lvl.hist.assign(history, -1); // initialize history
+        lvl.head.assign(long(T::Command::MAX) * nodes, 0);
+
+        int child_level = l + 1;
+        if (child_level == int(T::Level::Row) || !spec->org_entry.count[child_level])
+            break; // rows (or children of unspecified number) are not instantiated
+        lvl.fanout = spec->org_entry.count[child_level];
+        nodes *= lvl.fanout;
+    }
+
+    init(level);
+}
+
+template <typename T>
+DRAM<T>::DRAM(T* spec, typename T::Level level, shared_ptr<vector<DRAMLevel<T>>> levels, int index) :
+    spec(spec), level(level), id(0), parent(NULL), levels(levels), index(index)
 {
+    init(level);
+}
 
+template <typename T>
+void DRAM<T>::init(typename T::Level level)
+{
     state = spec->start[(int)level];
     prereq = spec->prereq[int(level)];
     rowhit = spec->rowhit[int(level)];
@@ -198,33 +314,14 @@ DRAM<T>::DRAM(T* spec, typename T::Level level) :
     lambda = spec->lambda[int(level)];
     timing = spec->timing[int(level)];
 
-    fill_n(next, int(T::Command::MAX), -1); // initialize future
-    for (int cmd = 0; cmd < int(T::Command::MAX); cmd++) {
-        int dist = 0;
-        for (auto& t : timing[cmd])
-            dist = max(dist, t.dist);
-
-        if (dist)
-            prev[cmd].resize(dist, -1); // initialize history
-    }
-
-    // try to recursively construct my children
-    int child_level = int(level) + 1;
-    if (child_level == int(T::Level::Row))
-        return; // stop recursion: rows are not instantiated as nodes
-
-    int child_max = spec->org_entry.count[child_level];
-    if (!child_max)
-        return; // stop recursion: the number of children is unspecified
-
     // recursively construct my children
+    int child_max = (*levels)[int(level)].fanout;
     for (int i = 0; i < child_max; i++) {
-        DRAM<T>* child = new DRAM<T>(spec, typename T::Level(child_level));
+        DRAM<T>* child = new DRAM<T>(spec, typename T::Level(int(level) + 1), levels, index * child_max + i);
         child->parent = this;
         child->id = i;
         children.push_back(child);
     }
-
 }
 
 template <typename T>
@@ -234,15 +331,6 @@ DRAM<T>::~DRAM()
         delete child;
 }
 
-// Insert
-template <typename T>
-void DRAM<T>::insert(DRAM<T>* child)
-{
-    child->parent = this;
-    child->id = children.size();
-    children.push_back(child);
-}
-
 // Decode
 template <typename T>
 typename T::Command DRAM<T>::decode(typename T::Command cmd, const int* addr)
@@ -266,15 +354,20 @@ typename T::Command DRAM<T>::decode(typename T::Command cmd, const int* addr)
 template <typename T>
 bool DRAM<T>::check(typename T::Command cmd, const int* addr, long clk)
 {
-    if (next[int(cmd)] != -1 && clk < next[int(cmd)])
-        return false; // stop recursion: the check failed at this level
-
-    int child_id = addr[int(level)+1];
-    if (child_id < 0 || level == spec->scope[int(cmd)] || !children.size())
-        return true; // stop recursion: the check passed at all levels
-
-    // recursively check my child
-    return children[child_id]->check(cmd, addr, clk);
+    int node = index;
+    for (int l = int(level); ; l++) {
+        DRAMLevel<T>& lvl = (*levels)[l];
+        long next = lvl.next_of(cmd)[node];
+        if (next != -1 && clk < next)
+            return false; // the check failed at this level
+
+        int child_id = addr[l + 1];
+        if (child_id < 0 || l == int(spec->scope[int(cmd)]) || !lvl.fanout)
+            return true; // the check passed at all levels
+
+        // go on with my child
+        node = node * lvl.fanout + child_id;
+    }
 }
 
 // SAUGATA: added function to check whether a command is a row hit
@@ -312,11 +405,11 @@ bool DRAM<T>::check_row_open(typename T::Command cmd, const int* addr)
 template <typename T>
 long DRAM<T>::get_next(typename T::Command cmd, const int* addr)
 {
-    long next_clk = max(cur_clk, next[int(cmd)]);
-    auto node = this;
-    for (int l = int(level); l < int(spec->scope[int(cmd)]) && node->children.size() && addr[l + 1] >= 0; l++){
-        node = node->children[addr[l + 1]];
-        next_clk = max(next_clk, node->next[int(cmd)]);
+    int node = index;
+    long next_clk = max(cur_clk, (*levels)[int(level)].next_of(cmd)[node]);
+    for (int l = int(level); l < int(spec->scope[int(cmd)]) && (*levels)[l].fanout && addr[l + 1] >= 0; l++){
+        node = node * (*levels)[l].fanout + addr[l + 1];
+        next_clk = max(next_clk, (*levels)[l + 1].next_of(cmd)[node]);
     }
     return next_clk;
 }
@@ -351,6 +444,8 @@ void DRAM<T>::update_state(typename T::Command cmd, const int* addr)
 template <typename T>
 void DRAM<T>::update_timing(typename T::Command cmd, const int* addr, long clk)
 {
+    DRAMLevel<T>* lvl = &(*levels)[int(level)];
+
     // I am not a target node: I am merely one of its siblings
     if (id != addr[int(level)]) {
         for (auto& t : timing[int(cmd)]) {
@@ -359,50 +454,81 @@ void DRAM<T>::update_timing(typename T::Command cmd, const int* addr, long clk)
 
             assert (t.dist == 1);
 
-            long future = clk + t.val;
-            next[int(t.cmd)] = max(next[int(t.cmd)], future); // update future
+            long& next = lvl->next_of(t.cmd)[index];
+            next = max(next, clk + t.val); // update future
         }
-
-        return; // stop recursion: only target nodes should be recursed
-    }
-
-    // I am a target node
-    if (prev[int(cmd)].size()) {
-        prev[int(cmd)].pop_back();  // FIXME TIANSHI why pop back?
-        prev[int(cmd)].push_front(clk); // update history
+        return;
     }
 
-    for (auto& t : timing[int(cmd)]) {
-        if (t.sibling)
-            continue; // not an applicable timing parameter
-
-        long past = prev[int(cmd)][t.dist-1];
-        if (past < 0)
-            continue; // not enough history
-
-        long future = past + t.val;
-        next[int(t.cmd)] = max(next[int(t.cmd)], future); // update future
-        // TIANSHI: for refresh statistics
-        if (spec->is_refreshing(cmd) && spec->is_opening(t.cmd)) {
-          assert(past == clk);
-          begin_of_refreshing = clk;
-          end_of_refreshing = max(end_of_refreshing, next[int(t.cmd)]);
-          refresh_cycles += end_of_refreshing - clk;
-          if (cur_serving_requests > 0) {
-            refresh_intervals.push_back(make_pair(begin_of_refreshing, end_of_refreshing));
-          }
+    // Walk down the targets from me. At each level, update the target from
+    // its history, then all siblings of its target child at once. Some
+    // commands have timings that are higher than their scope levels, thus we
+    // do not stop at the cmd's scope level.
+    DRAM<T>* target = this;
+    int node = index;
+    for (int l = int(level); ; l++, lvl++) {
+        int dist = lvl->dist[int(cmd)];
+        if (dist) {
+            long* history = lvl->hist.data() + lvl->hist_begin[int(cmd)] + long(node) * dist;
+            int& head = lvl->head[long(cmd) * lvl->nodes + node];
+            head = (head == 0) ? dist - 1 : head - 1; // the oldest clock is dropped
+            history[head] = clk; // update history
+
+            for (auto& t : spec->timing[l][int(cmd)]) {
+                if (t.sibling)
+                    continue; // not an applicable timing parameter
+
+                int i = head + t.dist - 1;
+                long past = history[(i < dist) ? i : i - dist];
+                if (past < 0)
+                    continue; // not enough history
+
+                long& next = lvl->next_of(t.cmd)[node];
+                next = max(next, past + t.val); // update future
+                target->update_refresh(cmd, t.cmd, past, clk);
+            }
         }
-    }
 
-    // Some commands have timings that are higher that their scope levels, thus
-    // we do not stop at the cmd's scope level
-    if (!children.size())
-        return; // stop recursion: updated all levels
+        if (!lvl->fanout)
+            return; // updated all levels
+
+        int first = node * lvl->fanout, child_id = addr[l + 1];
+        DRAMLevel<T>* child_lvl = lvl + 1;
+        if (child_lvl->sibling_timing[int(cmd)]) {
+            for (auto& t : spec->timing[l + 1][int(cmd)]) {
+                if (!t.sibling)
+                    continue; // not an applicable timing parameter
+
+                assert (t.dist == 1);
 
-    // recursively update *all* of my children
-    for (auto child : children)
-        child->update_timing(cmd, addr, clk);
+                long future = clk + t.val;
+                long* next = child_lvl->next_of(t.cmd) + first;
+                for (int i = 0; i < lvl->fanout; i++)
+                    if (i != child_id)
+                        next[i] = max(next[i], future); // update future
+            }
+        }
+
+        if (child_id < 0)
+            return; // no child is a target
+        target = target->children[child_id];
+        node = first + child_id;
+    }
+}
 
+// TIANSHI: for refresh statistics
+template <typename T>
+void DRAM<T>::update_refresh(typename T::Command cmd, typename T::Command next_cmd, long past, long clk)
+{
+    if (!spec->is_refreshing(cmd) || !spec->is_opening(next_cmd))
+        return;
+    assert(past == clk);
+    begin_of_refreshing = clk;
+    end_of_refreshing = max(end_of_refreshing, (*levels)[int(level)].next_of(next_cmd)[index]);
+    refresh_cycles += end_of_refreshing - clk;
+    if (cur_serving_requests > 0) {
+      refresh_intervals.push_back(make_pair(begin_of_refreshing, end_of_refreshing));
+    }
 }
 
 template <typename T>
@@ -159,12 +159,14 @@ public:
     };
 
     /* Prerequisite */
-    function<Command(DRAM<DSARP>*, Command cmd, int)> prereq[int(Level::MAX)][int(Command::MAX)];
+    typedef Command (*PrereqFunc)(DRAM<DSARP>*, Command cmd, int);
+    PrereqFunc prereq[int(Level::MAX)][int(Command::MAX)] = {};
 
     // SAUGATA: added function object container for row hit status
     /* Row hit */
-    function<bool(DRAM<DSARP>*, Command cmd, int)> rowhit[int(Level::MAX)][int(Command::MAX)];
-    function<bool(DRAM<DSARP>*, Command cmd, int)> rowopen[int(Level::MAX)][int(Command::MAX)];
+    typedef bool (*RowhitFunc)(DRAM<DSARP>*, Command cmd, int);
+    RowhitFunc rowhit[int(Level::MAX)][int(Command::MAX)] = {};
+    RowhitFunc rowopen[int(Level::MAX)][int(Command::MAX)] = {};
 
     /* Timing */
     struct TimingEntry
@@ -177,7 +179,8 @@ public:
     vector<TimingEntry> timing[int(Level::MAX)][int(Command::MAX)];
 
     /* Lambda */
-    function<void(DRAM<DSARP>*, int)> lambda[int(Level::MAX)][int(Command::MAX)];
+    typedef void (*LambdaFunc)(DRAM<DSARP>*, int);
+    LambdaFunc lambda[int(Level::MAX)][int(Command::MAX)] = {};
 
     /* Organization */
     enum class Org : int
@@ -5,12 +5,15 @@
 #include "Memory.h"
 #include "DRAM.h"
 #include "Statistics.h"
+#include "TrafficGenerator.h"
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <stdlib.h>
+#include <deque>
 #include <functional>
 #include <map>
+#include <sstream>
 
 /* Standards */
 #include "Gem5Wrapper.h"
@@ -35,50 +38,233 @@ using namespace ramulator;
 bool ramulator::warmup_complete = false;
 
 template<typename T>
-void run_dramtrace(const Config& configs, Memory<T, Controller>& memory, const char* tracename) {
-
-    /* initialize DRAM trace */
-    Trace trace(tracename);
+void run_dramtrace(const Config& configs, Memory<T, Controller>& memory, const vector<const char*>& files) {
+
+    // Each trace (or traffic generator) is an independent stream of requests
+    // with its own coreid, which may limit how many of its reads are in flight.
+    // A stream reads its requests ahead in batches, which are mapped to
+    // address vectors at once.
+    struct Stream {
+        unique_ptr<Trace> trace;
+        unique_ptr<TrafficGenerator> generator;
+        int mlp = 0;          // most reads in flight, or 0 for no limit
+        int outstanding = 0;  // reads in flight
+        bool stall = false, end = false;
+        bool drained = false; // the trace or generator has no more requests
+        vector<long> addrs;
+        vector<Request::Type> types;
+        vector<AddrVec> addr_vecs;
+        size_t cur = 0, next = 0;  // the request being sent, and the one after
+    };
+    vector<Stream> streams(files.size());
+    const size_t batch = 64;
+    auto refill = [&memory, batch] (Stream& stream) {
+        stream.addrs.clear();
+        stream.types.clear();
+        long addr;
+        Request::Type type;
+        while (!stream.drained && stream.addrs.size() < batch) {
+            stream.drained = stream.generator
+                ? !stream.generator->get_request(addr, type)
+                : !stream.trace->get_dramtrace_request(addr, type);
+            if (stream.drained)
+                break;
+            stream.addrs.push_back(addr);
+            stream.types.push_back(type);
+        }
+        stream.addr_vecs.resize(stream.addrs.size());
+        memory.map_address(stream.addrs.data(), stream.addr_vecs.data(), stream.addrs.size());
+        stream.next = 0;
+    };
+
+    /* initialize DRAM traces, or traffic generators in their place */
+    vector<int> mlps;
+    stringstream mlp_list(configs["stream_mlp"]);
+    for (string mlp; getline(mlp_list, mlp, ',');)
+        mlps.push_back(atoi(mlp.c_str()));
+    for (size_t i = 0; i < streams.size(); i++) {
+        Stream& stream = streams[i];
+        if (TrafficGenerator::is_spec(files[i])) {
+            stream.generator.reset(new TrafficGenerator(files[i], memory.get_layout()));
+        } else {
+            stream.trace.reset(new Trace(files[i]));
+            stream.trace->prefetch = configs.trace_prefetch();
+            stream.trace->skip(Trace::Format::DRAM, configs.get_trace_skip_insts());
+        }
+        if (!mlps.empty())
+            stream.mlp = mlps[min(i, mlps.size() - 1)];
+    }
 
     /* run simulation */
-    bool stall = false, end = false;
+    Stats::EpochStats epochs(configs["epoch_file"], configs["epoch_stats"], configs.get_epoch_cycles(),
+                             [&memory]{memory.update_queue_stats();});
+    bool skip_idle = configs.skip_idle_cycles();
+    bool idle = false, end = false;
     int reads = 0, writes = 0, clks = 0;
-    long addr = 0;
-    Request::Type type = Request::Type::READ;
-    map<int, int> latencies;
-    auto read_complete = [&latencies](Request& r){latencies[r.depart - r.arrive]++;};
-
-    Request req(addr, type, read_complete);
+    vector<Request> reqs;
+    for (size_t i = 0; i < streams.size(); i++) {
+        Stream* stream = &streams[i];
+        auto read_complete = [stream](Request& r){stream->outstanding--;};
+        reqs.emplace_back(0, Request::Type::READ, read_complete, int(i));
+    }
 
     while (!end || memory.pending_requests()){
-        if (!end && !stall){
-            end = !trace.get_dramtrace_request(addr, type);
-        }
-
-        if (!end){
-            req.addr = addr;
+        // every stream gets one try to send per cycle; the first try rotates
+        idle = end = true;
+        for (size_t n = 0; n < streams.size(); n++) {
+            int i = (clks + n) % streams.size();
+            Stream& stream = streams[i];
+            if (!stream.end && !stream.stall){
+                if (stream.next == stream.addrs.size())
+                    refill(stream);
+                stream.end = stream.addrs.empty();
+                stream.cur = stream.next++;
+            }
+            if (stream.end)
+                continue;
+            end = false;
+
+            Request::Type type = stream.types[stream.cur];
+            if (type == Request::Type::READ && stream.mlp
+                    && stream.outstanding >= stream.mlp) {
+                stream.stall = true;  // until one of its reads completes
+                continue;
+            }
+            Request& req = reqs[i];
+            req.addr = stream.addrs[stream.cur];
             req.type = type;
-            stall = !memory.send(req);
-            if (!stall){
-                if (type == Request::Type::READ) reads++;
+            req.addr_vec = stream.addr_vecs[stream.cur];
+            stream.stall = !memory.send_mapped(req);
+            if (!stream.stall){
+                if (type == Request::Type::READ) {
+                    reads++;
+                    stream.outstanding++;
+                }
                 else if (type == Request::Type::WRITE) writes++;
+                idle = false;
             }
         }
-        else {
+        if (end) {
             memory.set_high_writeq_watermark(0.0f); // make sure that all write requests in the
                                                     // write queue are drained
         }
 
+        // A stalled or drained trace cannot send anything until a controller
+        // makes progress, so jump straight to the next controller event
+        if (skip_idle && idle) {
+            long skip = min(memory.idle_cycles(), epochs.left(clks) - 1);
+            if (skip > 0) {
+                memory.skip(skip);
+                clks += skip;
+                Stats::curTick += skip;
+            }
+        }
+
         memory.tick();
         clks ++;
         Stats::curTick++; // memory clock, global, for Statistics
+        epochs.tick(clks);
     }
+    epochs.finish(clks);
     // This a workaround for statistics set only initially lost in the end
     memory.finish();
     Stats::statlist.printall();
 
 }
 
+// Replays a memory trace open loop: each request arrives at the memory cycle
+// it is stamped with, waits in a frontend queue while the controllers are
+// full, and is sent to memory one request per cycle, as in run_dramtrace
+template<typename T>
+void run_timed_dramtrace(const Config& configs, Memory<T, Controller>& memory, const char* tracename) {
+
+    Trace trace(tracename);
+    trace.prefetch = configs.trace_prefetch();
+    trace.skip(Trace::Format::TimedDRAM, configs.get_trace_skip_insts());
+
+    ScalarStat frontend_delay_sum, frontend_delay_avg, frontend_delay_max, frontend_queue_max;
+    frontend_delay_sum.name("frontend_delay_sum")
+        .desc("Memory cycles requests waited in the frontend queue after their arrival, in total")
+        .precision(0)
+        ;
+    frontend_delay_avg.name("frontend_delay_avg")
+        .desc("Memory cycles a request waited in the frontend queue after its arrival, on average")
+        .precision(6)
+        ;
+    frontend_delay_max.name("frontend_delay_max")
+        .desc("Memory cycles a request waited in the frontend queue after its arrival, at most")
+        .precision(0)
+        ;
+    frontend_queue_max.name("frontend_queue_max")
+        .desc("Most requests that waited in the frontend queue at once")
+        .precision(0)
+        ;
+
+    /* run simulation */
+    Stats::EpochStats epochs(configs["epoch_file"], configs["epoch_stats"], configs.get_epoch_cycles(),
+                             [&memory]{memory.update_queue_stats();});
+    bool skip_idle = configs.skip_idle_cycles();
+    bool end;
+    long clks = 0, sent = 0, delay_sum = 0, delay_max = 0;
+    size_t queue_max = 0;
+    long cycle = 0, addr = 0;
+    Request::Type type = Request::Type::READ;
+    deque<pair<long, Request>> frontend;  // arrival cycle and request
+    auto read_complete = [](Request& r){};
+
+    end = !trace.get_timed_request(cycle, addr, type);
+    while (!end || !frontend.empty() || memory.pending_requests()) {
+        while (!end && cycle <= clks) {
+            frontend.emplace_back(cycle, Request(addr, type, read_complete));
+            end = !trace.get_timed_request(cycle, addr, type);
+        }
+        queue_max = max(queue_max, frontend.size());
+
+        bool stall = false;
+        if (!frontend.empty()) {
+            stall = !memory.send(frontend.front().second);
+            if (!stall) {
+                long delay = clks - frontend.front().first;
+                delay_sum += delay;
+                delay_max = max(delay_max, delay);
+                sent++;
+                frontend.pop_front();
+            }
+        }
+        if (end && frontend.empty()) {
+            memory.set_high_writeq_watermark(0.0f); // drain the write queues
+        }
+
+        // Nothing is sent until a controller makes progress or the next
+        // request arrives, so jump straight to the earlier of the two
+        if (skip_idle && (stall || frontend.empty())) {
+            long idle = memory.idle_cycles();
+            if (frontend.empty() && !end)
+                idle = min(idle, cycle - clks - 1);
+            idle = min(idle, epochs.left(clks) - 1);
+            if (idle > 0) {
+                memory.skip(idle);
+                clks += idle;
+                Stats::curTick += idle;
+            }
+        }
+
+        memory.tick();
+        clks ++;
+        Stats::curTick++; // memory clock, global, for Statistics
+        epochs.tick(clks);
+    }
+    epochs.finish(clks);
+
+    frontend_delay_sum = delay_sum;
+    frontend_delay_avg = sent ? double(delay_sum) / sent : 0.0;
+    frontend_delay_max = delay_max;
+    frontend_queue_max = queue_max;
+    // This a workaround for statistics set only initially lost in the end
+    memory.finish();
+    Stats::statlist.printall();
+}
+
 template <typename T>
 void run_cputrace(const Config& configs, Memory<T, Controller>& memory, const std::vector<const char *>& files)
 {
@@ -119,12 +305,20 @@ void run_cputrace(const Config& configs, Memory<T, Controller>& memory, const st
 
     printf("Starting the simulation...\n");
 
+    // the epochs start after warmup, so that its stats reset is not seen
+    Stats::EpochStats epochs(configs["epoch_file"], configs["epoch_stats"], configs.get_epoch_cycles(),
+                             [&memory]{memory.update_queue_stats();});
+    bool cpu_epochs = configs.cpu_epochs();
+    long cpu_clks = 0, mem_clks = 0;
+
     int tick_mult = cpu_tick * mem_tick;
     for (long i = 0; ; i++) {
         if (((i % tick_mult) % mem_tick) == 0) { // When the CPU is ticked cpu_tick times,
                                                  // the memory controller should be ticked mem_tick times
             proc.tick();
             Stats::curTick++; // processor clock, global, for Statistics
+            if (cpu_epochs)
+                epochs.tick(++cpu_clks);
 
             if (configs.calc_weighted_speedup()) {
                 if (proc.has_reached_limit()) {
@@ -141,10 +335,14 @@ void run_cputrace(const Config& configs, Memory<T, Controller>& memory, const st
             }
         }
 
-        if (((i % tick_mult) % cpu_tick) == 0) // TODO_hasan: Better if the processor ticks the memory controller
+        if (((i % tick_mult) % cpu_tick) == 0) { // TODO_hasan: Better if the processor ticks the memory controller
             memory.tick();
+            if (!cpu_epochs)
+                epochs.tick(++mem_clks);
+        }
 
     }
+    epochs.finish(cpu_epochs ? cpu_clks : mem_clks);
     // This a workaround for statistics set only initially lost in the end
     memory.finish();
     Stats::statlist.printall();
@@ -168,18 +366,26 @@ void start_run(const Config& configs, T* spec, const vector<const char*>& files)
   Memory<T, Controller> memory(configs, ctrls);
 
   assert(files.size() != 0);
+  if (configs["trace_type"] == "DRAM" && configs.cpu_epochs())
+    printf("WARNING: epoch_clock = cpu needs CPU trace mode; epochs are in memory cycles.\n");
   if (configs["trace_type"] == "CPU") {
     run_cputrace(configs, memory, files);
+  } else if (configs["trace_type"] == "DRAM" && configs.trace_timestamps()) {
+    if (files.size() > 1)
+      printf("WARNING: trace_timestamps replays only the first trace.\n");
+    run_timed_dramtrace(configs, memory, files[0]);
   } else if (configs["trace_type"] == "DRAM") {
-    run_dramtrace(configs, memory, files[0]);
+    run_dramtrace(configs, memory, files);
   }
 }
 
 int main(int argc, const char *argv[])
 {
     if (argc < 2) {
-        printf("Usage: %s <configs-file> --mode=cpu,dram [--stats <filename>] <trace-filename1> <trace-filename2>\n"
-            "Example: %s ramulator-configs.cfg --mode=cpu cpu.trace cpu.trace\n", argv[0], argv[0]);
+        printf("Usage: %s <configs-file> --mode=cpu,dram [--stats <filename>] [--stats-format text,json,csv,binary] <trace-filename1> <trace-filename2>\n"
+            "Example: %s ramulator-configs.cfg --mode=cpu cpu.trace cpu.trace\n"
+            "In dram mode, gen:<pattern>[,<option>=<value>]... generates traffic instead of\n"
+            "reading a trace (see TrafficGenerator.h), e.g., gen:random,requests=1M\n", argv[0], argv[0]);
         return 0;
     }
 
@@ -200,16 +406,23 @@ int main(int argc, const char *argv[])
     }
 
     int trace_start = 3;
-    string stats_out;
+    string stats_out = standard + string(".stats");
     if (strcmp(argv[trace_start], "--stats") == 0) {
-      Stats::statlist.output(argv[trace_start+1]);
       stats_out = argv[trace_start+1];
       trace_start += 2;
-    } else {
-      Stats::statlist.output(standard+".stats");
-      stats_out = standard + string(".stats");
     }
 
+    string stats_format = "text";
+    if (strcmp(argv[trace_start], "--stats-format") == 0) {
+      stats_format = argv[trace_start+1];
+      trace_start += 2;
+    }
+    if (!Stats::statlist.output(stats_out, stats_format)) {
+      printf("invalid stats format: %s (text, json, csv or binary)\n", stats_format.c_str());
+      return 1;
+    }
+    configs.add("epoch_file", stats_out + ".epochs");
+
     // A separate file defines mapping for easy config.
     if (strcmp(argv[trace_start], "--mapping") == 0) {
       configs.add("mapping", argv[trace_start+1]);
@@ -7,6 +7,8 @@
 #include "Controller.h"
 #include "SpeedyController.h"
 #include "Statistics.h"
+#include "TrafficGenerator.h"
+#include "WorkerPool.h"
 #include "GDDR5.h"
 #include "HBM.h"
 #include "LPDDR3.h"
@@ -17,14 +19,18 @@
 #include <functional>
 #include <cmath>
 #include <cassert>
+#include <cstdlib>
+#include <iostream>
 #include <tuple>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <type_traits>
+#include <unordered_map>
 
 using namespace std;
 
-typedef vector<unsigned int> MapSrcVector;
-typedef map<unsigned int, MapSrcVector > MapSchemeEntry;
-typedef map<unsigned int, MapSchemeEntry> MapScheme;
-
 namespace ramulator
 {
 
@@ -46,6 +52,8 @@ public:
 template <class T, template<typename> class Controller = Controller >
 class Memory : public MemoryBase
 {
+    static_assert(int(T::Level::MAX) <= AddrVec::capacity, "AddrVec cannot hold all levels");
+
 protected:
   ScalarStat dram_capacity;
   ScalarStat num_dram_cycles;
@@ -71,7 +79,10 @@ protected:
 #endif
 
   long max_address;
-  MapScheme mapping_scheme;
+
+  // Mapping file compiled into one mask of physical address bits per bit of
+  // each level: the bit is the parity of the address bits under its mask
+  vector<unsigned long> mapping_masks[int(T::Level::MAX)];
   
 public:
     enum class Type {
@@ -91,9 +102,15 @@ public:
       {"Random", Translation::Random},
     };
 
+    // Physical pages are handed out by a Fisher-Yates shuffle that runs as
+    // pages are allocated: the first free_physical_pages_remaining entries
+    // are the pages that are still free, in no particular order.
     vector<int> free_physical_pages;
     long free_physical_pages_remaining;
-    map<pair<int, long>, long> page_translation;
+    int page_bits = 12;
+    long translation_seed = 0;
+    vector<unordered_map<long, long>> page_translation;  // per core, virtual to physical page
+    vector<mt19937_64> page_rngs;  // per core
 
     vector<Controller<T>*> ctrls;
     T * spec;
@@ -104,6 +121,9 @@ public:
     
     int tx_bits;
 
+    // ticks the channels in parallel (only when channel_threads > 1)
+    unique_ptr<WorkerPool> channel_pool;
+
     Memory(const Config& configs, vector<Controller<T>*> ctrls)
         : ctrls(ctrls),
           spec(ctrls[0]->channel->spec),
@@ -119,16 +139,6 @@ public:
         tx_bits = calc_log2(tx);
         assert((1<<tx_bits) == tx);
         
-        // Parsing mapping file and initialize mapping table
-        use_mapping_file = false;
-        dump_mapping = false;
-        if (spec->standard_name.substr(0, 4) == "DDR3"){
-            if (configs["mapping"] != "defaultmapping"){
-              init_mapping_with_file(configs["mapping"]);
-              // dump_mapping = true;
-              use_mapping_file = true;
-            }
-        }
         // If hi address bits will not be assigned to Rows
         // then the chips must not be LPDDRx 6Gb, 12Gb etc.
         if (type != Type::RoBaRaCoCh && spec->standard_name.substr(0, 5) == "LPDDR")
@@ -143,16 +153,48 @@ public:
 
         addr_bits[int(T::Level::MAX) - 1] -= calc_log2(spec->prefetch_size);
 
+        // Parsing mapping file and initialize mapping table
+        use_mapping_file = false;
+        dump_mapping = false;
+        if (configs["mapping"] != "defaultmapping"){
+          init_mapping_with_file(configs["mapping"]);
+          // dump_mapping = true;
+          use_mapping_file = true;
+        }
+
         // Initiating translation
         if (configs.contains("translation")) {
           translation = name_to_translation[configs["translation"]];
         }
         if (translation != Translation::None) {
+          if (configs.contains("page_size"))
+            page_bits = parse_page_size(configs["page_size"]);
+          if (configs.contains("translation_seed"))
+            translation_seed = atol(configs["translation_seed"].c_str());
+
           // construct a list of available pages
-          // TODO: this should not assume a 4KB page!
-          free_physical_pages_remaining = max_address >> 12;
+          free_physical_pages_remaining = max_address >> page_bits;
+          if (free_physical_pages_remaining <= 0) {
+            cerr << "page_size exceeds the memory capacity: " << configs["page_size"] << endl;
+            exit(1);
+          }
+          free_physical_pages.resize(free_physical_pages_remaining);
+          iota(free_physical_pages.begin(), free_physical_pages.end(), 0);
+        }
 
-          free_physical_pages.resize(free_physical_pages_remaining, -1);
+        // Channels only interact through send(), so their controllers can be
+        // ticked concurrently. ALDRAM retimes the shared spec and DSARP draws
+        // from the global rand() during a tick, so they stay sequential. More
+        // threads than cores only slow the barrier down.
+        int threads = min(configs.get_channel_threads(), int(ctrls.size()));
+        if (thread::hardware_concurrency())
+          threads = min(threads, int(thread::hardware_concurrency()));
+        if (threads > 1 && !is_same<T, ALDRAM>::value && !is_same<T, DSARP>::value
+                && !configs.print_cmd_trace()) {
+          for (auto ctrl : ctrls)
+            ctrl->defer_callbacks = true;
+          channel_pool.reset(new WorkerPool(threads, ctrls.size(),
+              [this] (int c) { this->ctrls[c]->tick(); }));
         }
 
         dram_capacity
@@ -258,6 +300,7 @@ public:
 
     ~Memory()
     {
+        channel_pool.reset();
         for (auto ctrl: ctrls)
             delete ctrl;
         delete spec;
@@ -281,77 +324,186 @@ public:
     void tick()
     {
         ++num_dram_cycles;
-        int cur_que_req_num = 0;
-        int cur_que_readreq_num = 0;
-        int cur_que_writereq_num = 0;
+
+        bool is_active = false;
+        if (channel_pool) {
+          for (auto ctrl : ctrls)
+            is_active = is_active || ctrl->is_active();
+          channel_pool->run();
+          // deliver completed reads in channel order, as a sequential tick would
+          for (auto ctrl : ctrls) {
+            for (auto& req : ctrl->completed)
+              req.callback(req);
+            ctrl->completed.clear();
+          }
+        } else {
+          for (auto ctrl : ctrls) {
+            is_active = is_active || ctrl->is_active();
+            ctrl->tick();
+          }
+        }
+        if (is_active) {
+          ramulator_active_cycles++;
+        }
+    }
+
+    // The number of upcoming memory cycles in which no controller can make
+    // progress, i.e., in which tick() would only accumulate statistics
+    long idle_cycles()
+    {
+        long clk = ctrls[0]->clk;
+        long next_clk = numeric_limits<long>::max();
         for (auto ctrl : ctrls) {
-          cur_que_req_num += ctrl->readq.size() + ctrl->writeq.size() + ctrl->pending.size();
-          cur_que_readreq_num += ctrl->readq.size() + ctrl->pending.size();
-          cur_que_writereq_num += ctrl->writeq.size();
+            next_clk = min(next_clk, ctrl->get_next_event());
+            if (next_clk == clk + 1)
+                return 0;
         }
-        in_queue_req_num_sum += cur_que_req_num;
-        in_queue_read_req_num_sum += cur_que_readreq_num;
-        in_queue_write_req_num_sum += cur_que_writereq_num;
+        return next_clk - clk - 1;
+    }
 
+    // Fast-forward over cycles reported by idle_cycles()
+    void skip(long cycles)
+    {
+        num_dram_cycles += cycles;
         bool is_active = false;
         for (auto ctrl : ctrls) {
           is_active = is_active || ctrl->is_active();
-          ctrl->tick();
+          ctrl->skip(cycles);
         }
         if (is_active) {
-          ramulator_active_cycles++;
+          ramulator_active_cycles += cycles;
         }
     }
 
-    bool send(Request req)
+    // The address vector that send() maps a physical address to
+    void map_address(long addr, AddrVec& addr_vec)
     {
-        req.addr_vec.resize(addr_bits.size());
-        long addr = req.addr;
-        int coreid = req.coreid;
+        addr_vec.resize(addr_bits.size());
 
         // Each transaction size is 2^tx_bits, so first clear the lowest tx_bits bits
         clear_lower_bits(addr, tx_bits);
 
         if (use_mapping_file){
-            apply_mapping(addr, req.addr_vec);
+            apply_mapping(addr, addr_vec);
         }
         else {
             switch(int(type)){
                 case int(Type::ChRaBaRoCo):
                     for (int i = addr_bits.size() - 1; i >= 0; i--)
-                        req.addr_vec[i] = slice_lower_bits(addr, addr_bits[i]);
+                        addr_vec[i] = slice_lower_bits(addr, addr_bits[i]);
                     break;
                 case int(Type::RoBaRaCoCh):
-                    req.addr_vec[0] = slice_lower_bits(addr, addr_bits[0]);
-                    req.addr_vec[addr_bits.size() - 1] = slice_lower_bits(addr, addr_bits[addr_bits.size() - 1]);
+                    addr_vec[0] = slice_lower_bits(addr, addr_bits[0]);
+                    addr_vec[addr_bits.size() - 1] = slice_lower_bits(addr, addr_bits[addr_bits.size() - 1]);
                     for (int i = 1; i <= int(T::Level::Row); i++)
-                        req.addr_vec[i] = slice_lower_bits(addr, addr_bits[i]);
+                        addr_vec[i] = slice_lower_bits(addr, addr_bits[i]);
                     break;
                 default:
                     assert(false);
             }
         }
+    }
+
+    // Maps n physical addresses at once, for requests that are made in bulk
+    void map_address(const long* addrs, AddrVec* addr_vecs, int n)
+    {
+        if (use_mapping_file) {
+            apply_mapping(addrs, addr_vecs, n);
+            return;
+        }
+        for (int i = 0; i < n; i++)
+            map_address(addrs[i], addr_vecs[i]);
+    }
 
-        if(ctrls[req.addr_vec[0]]->enqueue(req)) {
+    bool send(Request req)
+    {
+        map_address(req.addr, req.addr_vec);
+        return send_mapped(req);
+    }
+
+    // Sends a request whose addr_vec is already mapped by map_address()
+    bool send_mapped(Request req)
+    {
+        int coreid = req.coreid;
+
+        // the controller takes over the request, so keep what the stats need
+        int channel = req.addr_vec[int(T::Level::Channel)];
+        Request::Type req_type = req.type;
+        if(ctrls[channel]->enqueue(req)) {
             // tally stats here to avoid double counting for requests that aren't enqueued
             ++num_incoming_requests;
-            if (req.type == Request::Type::READ) {
+            if (req_type == Request::Type::READ) {
               ++num_read_requests[coreid];
-              ++incoming_read_reqs_per_channel[req.addr_vec[int(T::Level::Channel)]];
+              ++incoming_read_reqs_per_channel[channel];
             }
-            if (req.type == Request::Type::WRITE) {
+            if (req_type == Request::Type::WRITE) {
               ++num_write_requests[coreid];
             }
-            ++incoming_requests_per_channel[req.addr_vec[int(T::Level::Channel)]];
+            ++incoming_requests_per_channel[channel];
             return true;
         }
 
         return false;
     }
     
+    // What a TrafficGenerator needs to make addresses for this memory
+    MemoryLayout get_layout()
+    {
+        MemoryLayout layout;
+        layout.capacity = max_address;
+        layout.tx_bytes = 1 << tx_bits;
+        for (int bits : addr_bits)
+            layout.sizes.push_back(1 << bits);
+        layout.row_level = int(T::Level::Row);
+        if (!use_mapping_file)
+            layout.address_of = [this] (const AddrVec& v) {return this->get_address(v);};
+        return layout;
+    }
+
+    // The address that send() maps to addr_vec, or -1 with a mapping file
+    long get_address(const AddrVec& addr_vec)
+    {
+        if (use_mapping_file)
+            return -1;
+        long addr = 0;
+        int column = addr_bits.size() - 1;
+        switch(int(type)){
+            case int(Type::ChRaBaRoCo):
+                for (int i = 0; i <= column; i++)
+                    addr = addr << addr_bits[i] | addr_vec[i];
+                break;
+            case int(Type::RoBaRaCoCh):
+                for (int i = int(T::Level::Row); i >= 1; i--)
+                    addr = addr << addr_bits[i] | addr_vec[i];
+                addr = addr << addr_bits[column] | addr_vec[column];
+                addr = addr << addr_bits[0] | addr_vec[0];
+                break;
+            default:
+                assert(false);
+        }
+        return addr << tx_bits;
+    }
+
     void init_mapping_with_file(string filename){
         ifstream file(filename);
         assert(file.good() && "Bad mapping file");
+        int *sz = spec->org_entry.count;
+        // the mapping covers the same address bits as the default ones
+        int addr_total_bits = accumulate(addr_bits.begin(), addr_bits.end(), 0);
+        int level_bits[int(T::Level::MAX)];
+        for (int i = 0 ; i < int(T::Level::MAX) ; i ++)
+        {
+            if ( i != int(T::Level::Row))
+            {
+                level_bits[i] = calc_log2(sz[i]);
+                addr_total_bits -= level_bits[i];
+            }
+        }
+        // Row address is an integer.
+        level_bits[int(T::Level::Row)] = min((int)sizeof(int)*8, max(addr_total_bits, calc_log2(sz[int(T::Level::Row)])));
+        for (int i = 0 ; i < int(T::Level::MAX) ; i ++)
+            mapping_masks[i].assign(level_bits[i], 0);
+
         // possible line types are:
         // 0. Empty line
         // 1. Direct bit assignment   : component N   = x
@@ -415,7 +567,7 @@ public:
                             target_min = min(target_bit, target_bit2);
                             target_max = max(target_bit, target_bit2);
                             while (target_min <= target_max){
-                                mapping_scheme[level][target_min].push_back(source_min);
+                                add_mapping_source(level, target_min, source_min);
                                 // cout << target_min << " <- " << source_min << endl;
                                 source_min ++;
                                 target_min ++;
@@ -423,7 +575,7 @@ public:
                         }
                         else {
                             source_bit = stoi(word);
-                            mapping_scheme[level][target_bit].push_back(source_bit);
+                            add_mapping_source(level, target_bit, source_bit);
                         }
                 }
                 if (end == string::npos) { // this is the last word
@@ -436,54 +588,63 @@ public:
             dump_mapping_scheme();
     }
     
+    // XOR physical address bit source into bit target of a level
+    void add_mapping_source(int level, int target, int source){
+        assert(source >= 0 && source < int(sizeof(long)*8) && "Mapping source bit out of range");
+        // bits beyond the width of a level are never read
+        if (target >= int(mapping_masks[level].size()))
+            return;
+        // a source listed twice cancels out, as it did in the XOR chain
+        mapping_masks[level][target] ^= 1ul << source;
+    }
+
     void dump_mapping_scheme(){
         cout << "Mapping Scheme: " << endl;
-        for (MapScheme::iterator mapit = mapping_scheme.begin(); mapit != mapping_scheme.end(); mapit++)
+        for (int level = 0; level < int(T::Level::MAX); level++)
         {
-            int level = mapit->first;
-            for (MapSchemeEntry::iterator entit = mapit->second.begin(); entit != mapit->second.end(); entit++){
-                cout << T::level_str[level] << "[" << entit->first << "] := ";
-                cout << "PhysicalAddress[" << *(entit->second.begin()) << "]";
-                entit->second.erase(entit->second.begin());
-                for (MapSrcVector::iterator it = entit->second.begin() ; it != entit->second.end(); it ++)
-                    cout << " xor PhysicalAddress[" << *it << "]";
+            for (unsigned int bit = 0; bit < mapping_masks[level].size(); bit++){
+                unsigned long mask = mapping_masks[level][bit];
+                if (!mask)
+                    continue;
+                cout << T::level_str[level] << "[" << bit << "] := ";
+                const char* sep = "";
+                for (int source = 0; mask; source++, mask >>= 1) {
+                    if (!(mask & 1))
+                        continue;
+                    cout << sep << "PhysicalAddress[" << source << "]";
+                    sep = " xor ";
+                }
                 cout << endl;
             }
         }
     }
-    
-    void apply_mapping(long addr, std::vector<int>& addr_vec){
-        int *sz = spec->org_entry.count;
-        int addr_total_bits = sizeof(addr_vec)*8;
-        int addr_bits [int(T::Level::MAX)];
-        for (int i = 0 ; i < int(T::Level::MAX) ; i ++)
+
+    void apply_mapping(long addr, AddrVec& addr_vec){
+        for (int lvl = 0; lvl < int(T::Level::MAX); lvl++)
         {
-            if ( i != int(T::Level::Row))
-            {
-                addr_bits[i] = calc_log2(sz[i]);
-                addr_total_bits -= addr_bits[i];
-            }
+            const vector<unsigned long>& masks = mapping_masks[lvl];
+            int value = 0;
+            for (unsigned int bit = 0; bit < masks.size(); bit++)
+                value |= (__builtin_popcountl(addr & masks[bit]) & 1) << bit;
+            addr_vec[lvl] = value;
         }
-        // Row address is an integer.
-        addr_bits[int(T::Level::Row)] = min((int)sizeof(int)*8, max(addr_total_bits, calc_log2(sz[int(T::Level::Row)])));
+    }
 
-        // printf("Address: %lx => ",addr);
-        for (unsigned int lvl = 0; lvl < int(T::Level::MAX); lvl++)
+    // Map n physical addresses at once, one level (i.e., one set of masks) at a time
+    void apply_mapping(const long* addrs, AddrVec* addr_vecs, int n){
+        for (int i = 0; i < n; i++)
+            addr_vecs[i].resize(int(T::Level::MAX));
+        for (int lvl = 0; lvl < int(T::Level::MAX); lvl++)
         {
-            unsigned int lvl_bits = addr_bits[lvl];
-            addr_vec[lvl] = 0;
-            for (unsigned int bitindex = 0 ; bitindex < lvl_bits ; bitindex++){
-                bool bitvalue = false;
-                for (MapSrcVector::iterator it = mapping_scheme[lvl][bitindex].begin() ;
-                    it != mapping_scheme[lvl][bitindex].end(); it ++)
-                {
-                    bitvalue = bitvalue xor get_bit_at(addr, *it);
-                }
-                addr_vec[lvl] |= (bitvalue << bitindex);
+            const vector<unsigned long>& masks = mapping_masks[lvl];
+            for (int i = 0; i < n; i++) {
+                long addr = addrs[i] >> tx_bits;
+                int value = 0;
+                for (unsigned int bit = 0; bit < masks.size(); bit++)
+                    value |= (__builtin_popcountl(addr & masks[bit]) & 1) << bit;
+                addr_vecs[i][lvl] = value;
             }
-            // printf("%s: %x, ",T::level_str[lvl].c_str(),addr_vec[lvl]);
         }
-        // printf("\n");
     }
 
     int pending_requests()
@@ -504,6 +665,20 @@ public:
         ctrl->set_low_writeq_watermark(watermark);
     }
 
+    // Brings the queue length sums up to date, from the occupancy integrated
+    // by each controller (pending reads always count as queued here)
+    void update_queue_stats() {
+      long read_reqs = 0, write_reqs = 0;
+      for (auto ctrl : ctrls) {
+        ctrl->update_queue_stats();
+        read_reqs += ctrl->readq_length.integral(ctrl->clk) + ctrl->pending_length.integral(ctrl->clk);
+        write_reqs += ctrl->writeq_length.integral(ctrl->clk);
+      }
+      in_queue_req_num_sum = read_reqs + write_reqs;
+      in_queue_read_req_num_sum = read_reqs;
+      in_queue_write_req_num_sum = write_reqs;
+    }
+
     void finish(void) {
       dram_capacity = max_address;
       int *sz = spec->org_entry.count;
@@ -515,57 +690,46 @@ public:
       }
 
       // finalize average queueing requests
+      update_queue_stats();
       in_queue_req_num_avg = in_queue_req_num_sum.value() / dram_cycles;
       in_queue_read_req_num_avg = in_queue_read_req_num_sum.value() / dram_cycles;
       in_queue_write_req_num_avg = in_queue_write_req_num_sum.value() / dram_cycles;
     }
 
     long page_allocator(long addr, int coreid) {
-        long virtual_page_number = addr >> 12;
-
         switch(int(translation)) {
             case int(Translation::None): {
               return addr;
             }
             case int(Translation::Random): {
-                auto target = make_pair(coreid, virtual_page_number);
-                if(page_translation.find(target) == page_translation.end()) {
-                    // page doesn't exist, so assign a new page
-                    // make sure there are physical pages left to be assigned
+                if (coreid >= int(page_translation.size())) {
+                    page_translation.resize(coreid + 1);
+                    while (int(page_rngs.size()) <= coreid)
+                        page_rngs.emplace_back(translation_seed + page_rngs.size());
+                }
+                mt19937_64& rng = page_rngs[coreid];
 
-                    // if physical page doesn't remain, replace a previous assigned
-                    // physical page.
+                long virtual_page_number = addr >> page_bits;
+                auto target = page_translation[coreid].find(virtual_page_number);
+                if (target == page_translation[coreid].end()) {
+                    // page doesn't exist, so assign a new page
+                    long phys_page;
                     if (!free_physical_pages_remaining) {
+                      // if physical page doesn't remain, replace a previous assigned
+                      // physical page.
                       physical_page_replacement++;
-                      long phys_page_to_read = lrand() % free_physical_pages.size();
-                      assert(free_physical_pages[phys_page_to_read] != -1);
-                      page_translation[target] = phys_page_to_read;
+                      phys_page = rng() % free_physical_pages.size();
                     } else {
-                        // assign a new page
-                        long phys_page_to_read = lrand() % free_physical_pages.size();
-                        // if the randomly-selected page was already assigned
-                        if(free_physical_pages[phys_page_to_read] != -1) {
-                            long starting_page_of_search = phys_page_to_read;
-
-                            do {
-                                // iterate through the list until we find a free page
-                                // TODO: does this introduce serious non-randomness?
-                                ++phys_page_to_read;
-                                phys_page_to_read %= free_physical_pages.size();
-                            }
-                            while((phys_page_to_read != starting_page_of_search) && free_physical_pages[phys_page_to_read] != -1);
-                        }
-
-                        assert(free_physical_pages[phys_page_to_read] == -1);
-
-                        page_translation[target] = phys_page_to_read;
-                        free_physical_pages[phys_page_to_read] = coreid;
-                        --free_physical_pages_remaining;
+                      // move a random free page behind the free ones
+                      long i = rng() % free_physical_pages_remaining;
+                      --free_physical_pages_remaining;
+                      swap(free_physical_pages[i], free_physical_pages[free_physical_pages_remaining]);
+                      phys_page = free_physical_pages[free_physical_pages_remaining];
                     }
+                    target = page_translation[coreid].emplace(virtual_page_number, phys_page).first;
                 }
 
-                // SAUGATA TODO: page size should not always be fixed to 4KB
-                return (page_translation[target] << 12) | (addr & ((1 << 12) - 1));
+                return (target->second << page_bits) | (addr & ((1L << page_bits) - 1));
             }
             default:
                 assert(false);
@@ -587,20 +751,17 @@ private:
         addr >>= bits;
         return lbits;
     }
-    bool get_bit_at(long addr, int bit)
-    {
-        return (((addr >> bit) & 1) == 1);
-    }
     void clear_lower_bits(long& addr, int bits)
     {
         addr >>= bits;
     }
-    long lrand(void) {
-        if(sizeof(int) < sizeof(long)) {
-            return static_cast<long>(rand()) << (sizeof(int) * 8) | rand();
-        }
-
-        return rand();
+    static int parse_page_size(const string& name)
+    {
+        if (name == "4K") return 12;
+        if (name == "2M") return 21;
+        if (name == "1G") return 30;
+        cerr << "Unsupported page_size: " << name << " (4K, 2M, 1G)" << endl;
+        exit(1);
     }
 };
 
@@ -1,5 +1,6 @@
 #include "Processor.h"
 #include <cassert>
+#include <sys/stat.h>
 
 using namespace std;
 using namespace ramulator;
@@ -38,8 +39,9 @@ Processor::Processor(const Config& configs,
     }
   }
   for (int i = 0 ; i < tracenum ; ++i) {
-    cores[i]->callback = std::bind(&Processor::receive, this,
-        placeholders::_1);
+    // a capture of just `this` fits std::function's inline storage, so the
+    // callback is copied along with every request without allocating
+    cores[i]->callback = [this] (Request& req) { this->receive(req); };
   }
 
   // regStats
@@ -146,6 +148,9 @@ Core::Core(const Config& configs, int coreid,
   // set expected limit instruction for calculating weighted speedup
   expected_limit_insts = configs.get_expected_limit_insts();
   trace.expected_limit_insts = expected_limit_insts;
+  trace.prefetch = configs.trace_prefetch();
+  trace.skip(no_core_caches ? Trace::Format::Filtered : Trace::Format::Unfiltered,
+      configs.get_trace_skip_insts());
 
   // Build cache hierarchy
   if (no_core_caches) {
@@ -199,6 +204,16 @@ Core::Core(const Config& configs, int coreid,
           .precision(0)
           ;
   cpu_inst = 0;
+  read_reqs.name("read_requests_core_" + to_string(id))
+           .desc("Number of read requests sent by this core")
+           .precision(0)
+           ;
+  read_reqs = 0;
+  write_reqs.name("write_requests_core_" + to_string(id))
+            .desc("Number of write requests sent by this core")
+            .precision(0)
+            ;
+  write_reqs = 0;
 }
 
 
@@ -243,17 +258,19 @@ void Core::tick()
         if (window.is_full()) return;
 
         Request req(req_addr, req_type, callback, id);
-        if (!send(req)) return;
+        if (!send(move(req))) return;
 
         window.insert(false, req_addr);
         cpu_inst++;
+        read_reqs++;
     }
     else {
         // write request
         assert(req_type == Request::Type::WRITE);
         Request req(req_addr, req_type, callback, id);
-        if (!send(req)) return;
+        if (!send(move(req))) return;
         cpu_inst++;
+        write_reqs++;
     }
     if (long(cpu_inst.value()) == expected_limit_insts && !reached_limit) {
       record_cycs = clk;
@@ -374,44 +391,227 @@ void Window::set_ready(long addr, int mask)
 
 
 
-Trace::Trace(const char* trace_fname) : file(trace_fname), trace_name(trace_fname)
+Trace::Trace(const char* trace_fname)
+    : source(TraceSource::open(trace_fname)), file(source.get()), trace_name(trace_fname)
 {
-    if (!file.good()) {
+    if (!source) {
         std::cerr << "Bad trace file: " << trace_fname << std::endl;
         exit(1);
     }
+    binary = header.read(file);
+    if (binary) {
+        if (header.version != TraceHeader::current_version) {
+            std::cerr << "Unsupported binary trace version " << header.version
+                << ": " << trace_fname << std::endl;
+            exit(1);
+        }
+        records_left = header.records;
+    } else {
+        rewind();
+    }
+}
+
+Trace::~Trace()
+{
+    if (ring) {
+        ring->stop();
+        prefetcher.join();
+    }
+}
+
+void Trace::rewind()
+{
+    file.clear();
+    source->rewind();
+    if (binary) {
+        file.ignore(TraceHeader::size);
+        decoder.reset();
+        records_left = header.records;
+    }
+}
+
+namespace {
+
+// Text traces are parsed straight from the bytes of the trace source,
+// following std::stoul (bases 0 and 16) and std::getline
+
+inline void skip_spaces(std::streambuf& in)
+{
+    while (in.sgetc() == ' ' || in.sgetc() == '\t')
+        in.sbumpc();
+}
+
+inline int digit_value(int c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return 16;
+}
+
+long parse_number(std::streambuf& in, int base)
+{
+    skip_spaces(in);
+    if (in.sgetc() == '0') {
+        in.sbumpc();
+        if (in.sgetc() == 'x' || in.sgetc() == 'X') {
+            in.sbumpc();
+            base = 16;
+        } else if (base == 0) {
+            base = 8;
+        }
+    } else {
+        assert(digit_value(in.sgetc()) < (base ? base : 10) && "Bad trace line");
+        if (base == 0)
+            base = 10;
+    }
+    unsigned long value = 0;
+    for (int d; (d = digit_value(in.sgetc())) < base; in.sbumpc())
+        value = value * base + d;
+    return value;
+}
+
+// Consumes the rest of the line; false if the trace ends before a newline
+bool end_line(std::streambuf& in)
+{
+    for (int c = in.sbumpc(); c != '\n'; c = in.sbumpc())
+        if (c == std::streambuf::traits_type::eof())
+            return false;
+    return true;
+}
+
+} /*namespace*/
+
+bool Trace::read_record(Format format, TraceRecord& record)
+{
+    std::streambuf& in = *source;
+    if (binary) {
+        if (header.kind != binary_kind(format)) {
+            std::cerr << "Binary trace of the wrong kind for this mode (see tracetool): "
+                << trace_name << std::endl;
+            exit(1);
+        }
+        if (!records_left || !decoder.get(in, record))
+            return false;
+        records_left--;
+        return true;
+    }
+
+    int c = in.sgetc();
+    if (c == std::streambuf::traits_type::eof()
+            || (format == Format::Filtered && c == '\n'))
+        return false;
+
+    record = TraceRecord();
+    if (format == Format::DRAM) {
+        record.addr = parse_number(in, 16);
+    } else {
+        record.bubble_cnt = parse_number(in, 10);
+        record.addr = parse_number(in, format == Format::TimedDRAM ? 16 : 0);
+    }
+
+    skip_spaces(in);
+    c = in.sgetc();
+    if (format == Format::Filtered) {
+        if (c != '\n' && c != std::streambuf::traits_type::eof()) {
+            record.has_writeback = true;
+            record.writeback_addr = parse_number(in, 0);
+        }
+    } else {
+        if (c == 'W')
+            record.is_write = true;
+        else assert((c == 'R' || c == '\n' || c == std::streambuf::traits_type::eof())
+            && "Bad trace line");
+    }
+    return end_line(in);
+}
+
+bool Trace::next_record(Format format, TraceRecord& record)
+{
+    if (!prefetch) {
+        if (read_record(format, record))
+            return true;
+        if (loops(format))
+            rewind();
+        return false;
+    }
+
+    if (!ring) {
+        // the first request decides the format that is read ahead
+        ring.reset(new SpscRing<Prefetched>(prefetch_depth));
+        prefetcher = std::thread(&Trace::prefetch_records, this, format);
+    }
+    if (ended)
+        return false;
+    Prefetched item;
+    ring->pop(item);
+    record = item.record;
+    ended = !item.valid && !loops(format);
+    return item.valid;
+}
+
+void Trace::prefetch_records(Format format)
+{
+    Prefetched item;
+    do {
+        item.valid = read_record(format, item.record);
+        if (!item.valid && loops(format))
+            rewind();
+        if (!ring->push(item))
+            return;
+    } while (item.valid || loops(format));
+}
+
+void Trace::skip(Format format, long insts)
+{
+    // the index counts the cycles of timed records as instructions
+    bool timed = (format == Format::TimedDRAM);
+    uint64_t skipped = 0;
+    TraceIndex index;
+    std::string index_name = trace_name + ".idx";
+    std::ifstream index_file(index_name, std::ios::binary);
+    if (insts > 0 && !timed && index_file && !index.read(index_file)) {
+        std::cerr << "Ignoring corrupt trace index " << index_name << std::endl;
+    } else if (insts > 0 && !timed && index_file) {
+        struct stat st;
+        if (index.version != TraceIndex::current_version
+                || stat(trace_name.c_str(), &st) || uint64_t(st.st_size) != index.trace_size) {
+            std::cerr << "Ignoring stale trace index " << index_name << std::endl;
+        } else if (const TraceIndex::Entry* entry = index.find(insts)) {
+            file.clear();
+            source->seek(entry->offset);
+            if (binary) {
+                decoder.reset(entry->prev_addr);
+                records_left = header.records - entry->records;
+            }
+            skipped = entry->insts;
+        }
+    }
+
+    TraceRecord record;
+    while (skipped < uint64_t(std::max(insts, 0l))) {
+        if (!read_record(format, record)) {
+            std::cerr << "Trace " << trace_name << " ends before instruction "
+                << insts << std::endl;
+            exit(1);
+        }
+        skipped += timed ? 1 : TraceIndex::insts(record);
+    }
 }
 
 bool Trace::get_unfiltered_request(long& bubble_cnt, long& req_addr, Request::Type& req_type)
 {
-    string line;
-    getline(file, line);
-    if (file.eof()) {
-      file.clear();
-      file.seekg(0, file.beg);
-      getline(file, line);
-      //return false;
-    }
-    size_t pos, end;
-    bubble_cnt = std::stoul(line, &pos, 10);
-    pos = line.find_first_not_of(' ', pos+1);
-    req_addr = std::stoul(line.substr(pos), &end, 0);
-
-    pos = line.find_first_not_of(' ', pos+end);
-
-    if (pos == string::npos || line.substr(pos)[0] == 'R')
-        req_type = Request::Type::READ;
-    else if (line.substr(pos)[0] == 'W')
-        req_type = Request::Type::WRITE;
-    else assert(false);
+    TraceRecord record;
+    if (!next_record(Format::Unfiltered, record))
+        next_record(Format::Unfiltered, record);  // starting over the input trace file
+    bubble_cnt = record.bubble_cnt;
+    req_addr = record.addr;
+    req_type = record.is_write ? Request::Type::WRITE : Request::Type::READ;
     return true;
 }
 
 bool Trace::get_filtered_request(long& bubble_cnt, long& req_addr, Request::Type& req_type)
 {
-    static bool has_write = false;
-    static long write_addr;
-    static int line_num = 0;
     if (has_write){
         bubble_cnt = 0;
         req_addr = write_addr;
@@ -419,55 +619,43 @@ bool Trace::get_filtered_request(long& bubble_cnt, long& req_addr, Request::Type
         has_write = false;
         return true;
     }
-    string line;
-    getline(file, line);
-    line_num ++;
-    if (file.eof() || line.size() == 0) {
-        file.clear();
-        file.seekg(0, file.beg);
-        line_num = 0;
-
+    TraceRecord record;
+    if (!next_record(Format::Filtered, record)) {
         if(expected_limit_insts == 0) {
-            has_write = false;
             return false;
         }
         else { // starting over the input trace file
-            getline(file, line);
-            line_num++;
+            next_record(Format::Filtered, record);
         }
     }
 
-    size_t pos, end;
-    bubble_cnt = std::stoul(line, &pos, 10);
-
-    pos = line.find_first_not_of(' ', pos+1);
-    req_addr = stoul(line.substr(pos), &end, 0);
+    bubble_cnt = record.bubble_cnt;
+    req_addr = record.addr;
     req_type = Request::Type::READ;
-
-    pos = line.find_first_not_of(' ', pos+end);
-    if (pos != string::npos){
+    if (record.has_writeback) {
         has_write = true;
-        write_addr = stoul(line.substr(pos), NULL, 0);
+        write_addr = record.writeback_addr;
     }
     return true;
 }
 
-bool Trace::get_dramtrace_request(long& req_addr, Request::Type& req_type)
+bool Trace::get_timed_request(long& cycle, long& req_addr, Request::Type& req_type)
 {
-    string line;
-    getline(file, line);
-    if (file.eof()) {
+    TraceRecord record;
+    if (!next_record(Format::TimedDRAM, record))
         return false;
-    }
-    size_t pos;
-    req_addr = std::stoul(line, &pos, 16);
-
-    pos = line.find_first_not_of(' ', pos+1);
+    cycle = record.bubble_cnt;
+    req_addr = record.addr;
+    req_type = record.is_write ? Request::Type::WRITE : Request::Type::READ;
+    return true;
+}
 
-    if (pos == string::npos || line.substr(pos)[0] == 'R')
-        req_type = Request::Type::READ;
-    else if (line.substr(pos)[0] == 'W')
-        req_type = Request::Type::WRITE;
-    else assert(false);
+bool Trace::get_dramtrace_request(long& req_addr, Request::Type& req_type)
+{
+    TraceRecord record;
+    if (!next_record(Format::DRAM, record))
+        return false;
+    req_addr = record.addr;
+    req_type = record.is_write ? Request::Type::WRITE : Request::Type::READ;
     return true;
 }
@@ -5,13 +5,18 @@
 #include "Config.h"
 #include "Memory.h"
 #include "Request.h"
+#include "SpscRing.h"
 #include "Statistics.h"
+#include "TraceFormat.h"
+#include "TraceSource.h"
 #include <iostream>
 #include <vector>
 #include <fstream>
 #include <string>
 #include <ctype.h>
 #include <functional>
+#include <memory>
+#include <thread>
 
 namespace ramulator 
 {
@@ -19,6 +24,7 @@ namespace ramulator
 class Trace {
 public:
     Trace(const char* trace_fname);
+    ~Trace();
     // trace file format 1:
     // [# of bubbles(non-mem instructions)] [read address(dec or hex)] <optional: write address(evicted cacheline)>
     bool get_unfiltered_request(long& bubble_cnt, long& req_addr, Request::Type& req_type);
@@ -26,12 +32,71 @@ public:
     // trace file format 2:
     // [address(hex)] [R/W]
     bool get_dramtrace_request(long& req_addr, Request::Type& req_type);
+    // trace file format 3 (trace_timestamps = on):
+    // [arrival memory cycle] [address(hex)] [R/W]
+    bool get_timed_request(long& cycle, long& req_addr, Request::Type& req_type);
+    // Either format can also be converted to the binary format of
+    // TraceFormat.h (see tracetool), which is detected by its header, and
+    // any trace can be compressed with gzip (or zstd, see the Makefile).
+
+    enum class Format {Unfiltered, Filtered, DRAM, TimedDRAM};
+    // Starts the trace at the first record at or after instruction insts
+    // (request insts, for a memory trace), from the closest entry of the
+    // index <trace>.idx if there is one. The trace still starts over from
+    // its beginning after its end.
+    void skip(Format format, long insts);
 
     long expected_limit_insts = 0;
+    // decode the trace ahead of the simulation in a thread of its own
+    bool prefetch = false;
 
 private:
-    std::ifstream file;
+    std::unique_ptr<TraceSource> source;  // plain or compressed trace file
+    std::istream file;
     std::string trace_name;
+
+    // the writeback of the last filtered record, returned by the next call
+    bool has_write = false;
+    long write_addr = 0;
+
+    bool binary = false;
+    TraceHeader header;
+    TraceDecoder decoder;
+    uint64_t records_left = 0;
+
+    // A record read ahead, or (if !valid) the end of the trace
+    struct Prefetched {
+        TraceRecord record;
+        bool valid = false;
+    };
+    static const size_t prefetch_depth = 4096;
+    std::unique_ptr<SpscRing<Prefetched>> ring;
+    std::thread prefetcher;
+    bool ended = false;  // a prefetched memory trace has ended
+
+    // CPU traces start over after their end, memory traces do not
+    static bool loops(Format format)
+    {
+        return format == Format::Unfiltered || format == Format::Filtered;
+    }
+    // The kind of binary trace that holds a format (MAX if none does)
+    static TraceHeader::Kind binary_kind(Format format)
+    {
+        switch (format) {
+            case Format::Unfiltered:
+            case Format::Filtered: return TraceHeader::Kind::CPU;
+            case Format::DRAM: return TraceHeader::Kind::DRAM;
+            case Format::TimedDRAM: return TraceHeader::Kind::TimedDRAM;
+            default: return TraceHeader::Kind::MAX;
+        }
+    }
+    void rewind();
+    // Reads the next line (or binary record), or returns false at the end
+    bool read_record(Format format, TraceRecord& record);
+    // As read_record, but a trace that loops starts over after its end, and
+    // records may come from the prefetch thread
+    bool next_record(Format format, TraceRecord& record);
+    void prefetch_records(Format format);
 };
 
 
@@ -110,6 +175,8 @@ private:
 
     ScalarStat memory_access_cycles;
     ScalarStat cpu_inst;
+    ScalarStat read_reqs;
+    ScalarStat write_reqs;
     MemoryBase& memory;
 };
 
@@ -3,19 +3,66 @@
 
 #include <vector>
 #include <functional>
+#include <algorithm>
+#include <cassert>
 
 using namespace std;
 
 namespace ramulator
 {
 
+// Address of a request at every level of the DRAM organization (T::Level).
+// The entries live inside the request itself, so copying or moving a request
+// never touches the heap.
+class AddrVec
+{
+public:
+    static const int capacity = 8; // >= T::Level::MAX of every standard
+
+    AddrVec() : len(0) {}
+    explicit AddrVec(int n, int value = 0) : len(n) {
+        assert(n <= capacity);
+        fill_n(vec, n, value);
+    }
+    AddrVec(const vector<int>& v) : len(v.size()) {
+        assert(len <= capacity);
+        copy(v.begin(), v.end(), vec);
+    }
+
+    int size() const {return len;}
+    bool empty() const {return len == 0;}
+    void resize(int n, int value = 0) {
+        assert(n <= capacity);
+        if (n > len)
+            fill(vec + len, vec + n, value);
+        len = n;
+    }
+
+    int* data() {return vec;}
+    const int* data() const {return vec;}
+    int* begin() {return vec;}
+    int* end() {return vec + len;}
+    const int* begin() const {return vec;}
+    const int* end() const {return vec + len;}
+    int& operator[](int i) {return vec[i];}
+    const int& operator[](int i) const {return vec[i];}
+
+    bool operator==(const AddrVec& other) const {
+        return len == other.len && equal(begin(), end(), other.begin());
+    }
+
+private:
+    int vec[capacity];
+    int len;
+};
+
 class Request
 {
 public:
     bool is_first_command;
     long addr;
     // long addr_row;
-    vector<int> addr_vec;
+    AddrVec addr_vec;
     // specify which core this request sent from, for virtual address translation
     int coreid;
 
@@ -34,15 +81,21 @@ public:
     long depart = -1;
     function<void(Request&)> callback; // call back with more info
 
+    // first command and the clock when it becomes ready, cached by the
+    // controller while the DRAM state is unchanged (i.e., for one epoch)
+    long ready_epoch = -1;
+    int first_cmd = -1;
+    long ready_clk = -1;
+
     Request(long addr, Type type, int coreid = 0)
         : is_first_command(true), addr(addr), coreid(coreid), type(type),
       callback([](Request& req){}) {}
 
     Request(long addr, Type type, function<void(Request&)> callback, int coreid = 0)
-        : is_first_command(true), addr(addr), coreid(coreid), type(type), callback(callback) {}
+        : is_first_command(true), addr(addr), coreid(coreid), type(type), callback(move(callback)) {}
 
-    Request(vector<int>& addr_vec, Type type, function<void(Request&)> callback, int coreid = 0)
-        : is_first_command(true), addr_vec(addr_vec), coreid(coreid), type(type), callback(callback) {}
+    Request(const AddrVec& addr_vec, Type type, function<void(Request&)> callback, int coreid = 0)
+        : is_first_command(true), addr_vec(addr_vec), coreid(coreid), type(type), callback(move(callback)) {}
 
     Request()
         : is_first_command(true), coreid(0) {}
@@ -18,15 +18,14 @@ Current Memory Scheduling Policies:
 3) FRFCFS_Cap - First Ready First Come First Serve Cap
        This scheduling policy behaves the same way as FRFCS, except that it has
        a cap on the number of hits you can get in a certain row. The CAP VALUE
-       can be altered by changing the number for the "cap" variable in 
-       line number 76. 
+       can be altered with the "scheduler_cap" config option (default 16).
 
 4) FRFCFS_PriorHit - First Ready First Come First Serve Prioritize Hits
        This scheduling policy behaves the same way as FRFCFS, except that it
        prioritizes row hits more than readiness. 
 
-You can select which scheduler you want to use by changing the value of 
-"type" variable on line number 74.
+You can select which scheduler you want to use with the "scheduler" config
+option (default FRFCFS_Cap). Each policy ranks a queue in a single pass.
 
                 _______________________________________
 
@@ -39,7 +38,10 @@ Current Row Policies:
               other rows.
 4) Timeout  - Precharges a row after X time if there are no pending references.
               'X' time can be changed by changing the variable timeout 
-              on line number 221
+              in RowPolicy.
+
+You can select which row policy you want to use with the "row_policy" config
+option (default Opened).
 
 *****************************************************************************/
 
@@ -49,10 +51,13 @@ Current Row Policies:
 #include "DRAM.h"
 #include "Request.h"
 #include "Controller.h"
+#include "SlabQueue.h"
 #include <vector>
-#include <map>
-#include <list>
+#include <cstdint>
+#include <cstdlib>
 #include <functional>
+#include <iostream>
+#include <limits>
 #include <cassert>
 
 using namespace std;
@@ -71,142 +76,143 @@ public:
 
     enum class Type {
         FCFS, FRFCFS, FRFCFS_Cap, FRFCFS_PriorHit, MAX
-    } type = Type::FRFCFS_Cap; //Change this line to change scheduling policy
+    } type = Type::FRFCFS_Cap; // set by the "scheduler" config option
 
-    long cap = 16; //Change this line to change cap
+    long cap = 16; // set by the "scheduler_cap" config option
 
     Scheduler(Controller<T>* ctrl) : ctrl(ctrl) {}
 
-    list<Request>::iterator get_head(list<Request>& q)
+    // Selects the policy by name from the "scheduler" config option
+    static Type parse_type(const string& name)
     {
-        // TODO make the decision at compile time
-        if (type != Type::FRFCFS_PriorHit) {
-            //If queue is empty, return end of queue
-            if (!q.size())
-                return q.end();
-
-            //Else return based on the policy
-            auto head = q.begin();
-            for (auto itr = next(q.begin(), 1); itr != q.end(); itr++)
-                head = compare[int(type)](head, itr);
-
-            return head;
-        } 
-        else { //Code to get around edge cases for FRFCFS_PriorHit
-            
-       //If queue is empty, return end of queue
-            if (!q.size())
-                return q.end();
-
-       //Else return based on FRFCFS_PriorHit Scheduling Policy
-            auto head = q.begin();
-            for (auto itr = next(q.begin(), 1); itr != q.end(); itr++) {
-                head = compare[int(Type::FRFCFS_PriorHit)](head, itr);
-            }
+        static const char* names[int(Type::MAX)] = {
+            "FCFS", "FRFCFS", "FRFCFS_Cap", "FRFCFS_PriorHit"
+        };
+        for (int i = 0; i < int(Type::MAX); i++)
+            if (name == names[i])
+                return Type(i);
+        cerr << "Invalid scheduler: " << name << endl;
+        exit(1);
+    }
 
-            if (this->ctrl->is_ready(head) && this->ctrl->is_row_hit(head)) {
-                return head;
-            }
+    SlabQueue::iterator get_head(SlabQueue& q)
+    {
+        switch (type) {
+            case Type::FCFS:
+                return pick(q, [] (ReqIter req) {return false;});
+            case Type::FRFCFS:
+                return pick(q, [this] (ReqIter req) {return this->ctrl->is_ready(req);});
+            case Type::FRFCFS_Cap:
+                return pick(q, [this] (ReqIter req) {
+                    return this->ctrl->is_ready(req)
+                        && this->ctrl->rowtable->get_hits(req->addr_vec) <= this->cap;});
+            default:
+                return get_head_prior_hit(q);
+        }
+    }
 
-            // prepare a list of hit request
-            vector<vector<int>> hit_reqs;
-            for (auto itr = q.begin() ; itr != q.end() ; ++itr) {
-                if (this->ctrl->is_row_hit(itr)) {
-                    auto begin = itr->addr_vec.begin();
-                    // TODO Here it assumes all DRAM standards use PRE to close a row
-                    // It's better to make it more general.
-                    auto end = begin + int(ctrl->channel->spec->scope[int(T::Command::PRE)]) + 1;
-                    vector<int> rowgroup(begin, end); // bank or subarray
-                    hit_reqs.push_back(rowgroup);
-                }
+private:
+    typedef SlabQueue::iterator ReqIter;
+
+    // Every policy picks the oldest request among those that are preferred
+    // (e.g., ready), and the oldest request overall if none is. Ties in
+    // arrival go to the request that was queued first. Requests for which
+    // skip() holds are not considered. prefer() is evaluated at most once
+    // per request, and not at all for requests that cannot beat the head.
+    template <typename Prefer, typename Skip>
+    ReqIter pick(SlabQueue& q, Prefer prefer, Skip skip, bool& head_preferred)
+    {
+        ReqIter head = q.end();
+        head_preferred = false;
+        for (auto itr = q.begin(); itr != q.end(); itr++) {
+            if (skip(itr))
+                continue;
+            if (head == q.end()) {
+                head = itr;
+                head_preferred = prefer(itr);
+                continue;
             }
-            // if we can't find proper request, we need to return q.end(),
-            // so that no command will be scheduled
-            head = q.end();
-            for (auto itr = q.begin(); itr != q.end(); itr++) {
-                bool violate_hit = false;
-                if ((!this->ctrl->is_row_hit(itr)) && this->ctrl->is_row_open(itr)) {
-                    // so the next instruction to be scheduled is PRE, might violate hit
-                    auto begin = itr->addr_vec.begin();
-                    // TODO Here it assumes all DRAM standards use PRE to close a row
-                    // It's better to make it more general.
-                    auto end = begin + int(ctrl->channel->spec->scope[int(T::Command::PRE)]) + 1;
-                    vector<int> rowgroup(begin, end); // bank or subarray
-                    for (const auto& hit_req_rowgroup : hit_reqs) {
-                        if (rowgroup == hit_req_rowgroup) {
-                            violate_hit = true;
-                            break;
-                        }  
-                    }
-                }
-                if (violate_hit) {
-                    continue;
-                }
-                // If it comes here, that means it won't violate any hit request
-                if (head == q.end()) {
+            if (head_preferred && head->arrive <= itr->arrive)
+                continue;
+            bool preferred = prefer(itr);
+            if (preferred != head_preferred) {
+                if (preferred) {
                     head = itr;
-                } else {
-                    head = compare[int(Type::FRFCFS)](head, itr);
+                    head_preferred = true;
                 }
+                continue;
             }
-
-            return head;
+            if (itr->arrive < head->arrive)
+                head = itr;
         }
+        return head;
     }
 
-//Compare functions for each memory schedulers
-private:
-    typedef list<Request>::iterator ReqIter;
-    function<ReqIter(ReqIter, ReqIter)> compare[int(Type::MAX)] = {
-        // FCFS
-        [this] (ReqIter req1, ReqIter req2) {
-            if (req1->arrive <= req2->arrive) return req1;
-            return req2;},
-
-        // FRFCFS
-        [this] (ReqIter req1, ReqIter req2) {
-            bool ready1 = this->ctrl->is_ready(req1);
-            bool ready2 = this->ctrl->is_ready(req2);
-
-            if (ready1 ^ ready2) {
-                if (ready1) return req1;
-                return req2;
-            }
-
-            if (req1->arrive <= req2->arrive) return req1;
-            return req2;},
-
-        // FRFCFS_CAP
-        [this] (ReqIter req1, ReqIter req2) {
-            bool ready1 = this->ctrl->is_ready(req1);
-            bool ready2 = this->ctrl->is_ready(req2);
-
-            ready1 = ready1 && (this->ctrl->rowtable->get_hits(req1->addr_vec) <= this->cap);
-            ready2 = ready2 && (this->ctrl->rowtable->get_hits(req2->addr_vec) <= this->cap);
+    template <typename Prefer>
+    ReqIter pick(SlabQueue& q, Prefer prefer)
+    {
+        bool head_preferred;
+        return pick(q, prefer, [] (ReqIter req) {return false;}, head_preferred);
+    }
 
-            if (ready1 ^ ready2) {
-                if (ready1) return req1;
-                return req2;
-            }
+    vector<AddrVec> hit_rowgroups;  // scratch space of get_head_prior_hit
 
-            if (req1->arrive <= req2->arrive) return req1;
-            return req2;},
-        // FRFCFS_PriorHit
-        [this] (ReqIter req1, ReqIter req2) {
-            bool ready1 = this->ctrl->is_ready(req1) && this->ctrl->is_row_hit(req1);
-            bool ready2 = this->ctrl->is_ready(req2) && this->ctrl->is_row_hit(req2);
+    // bank (or subarray) that a request's row belongs to
+    AddrVec get_rowgroup(ReqIter req)
+    {
+        // TODO Here it assumes all DRAM standards use PRE to close a row
+        // It's better to make it more general.
+        AddrVec rowgroup = req->addr_vec;
+        rowgroup.resize(int(ctrl->channel->spec->scope[int(T::Command::PRE)]) + 1);
+        return rowgroup;
+    }
 
-            if (ready1 ^ ready2) {
-                if (ready1) return req1;
-                return req2;
-            }
+    // FRFCFS_PriorHit: serve a ready row hit if there is one. Otherwise,
+    // schedule as FRFCFS, but never precharge a row that some other queued
+    // request still hits.
+    ReqIter get_head_prior_hit(SlabQueue& q)
+    {
+        bool head_preferred;
+        auto head = pick(q, [this] (ReqIter req) {
+                return this->ctrl->is_ready(req) && this->ctrl->is_row_hit(req);},
+            [] (ReqIter req) {return false;}, head_preferred);
+        if (head == q.end() || head_preferred)
+            return head;
 
-            if (req1->arrive <= req2->arrive) return req1;
-            return req2;}
-    };
+        // When PRE closes exactly one rowgroup, a queued request hits the
+        // row that req would close iff it targets the open row of req's
+        // rowgroup, which the per-row counts of the queue tell directly.
+        // Otherwise, prepare a list of hit requests.
+        bool per_row = ctrl->track_rows &&
+            int(ctrl->channel->spec->scope[int(T::Command::PRE)]) == int(T::Level::Row) - 1;
+        hit_rowgroups.clear();
+        if (!per_row)
+            for (auto itr = q.begin(); itr != q.end(); itr++)
+                if (ctrl->is_row_hit(itr))
+                    hit_rowgroups.push_back(get_rowgroup(itr));
+
+        // if we can't find proper request, we return q.end(),
+        // so that no command will be scheduled
+        return pick(q, [this] (ReqIter req) {return this->ctrl->is_ready(req);},
+            [this, &q, per_row] (ReqIter req) {
+                // the next command would be a PRE, which might violate a hit
+                if (this->ctrl->is_row_hit(req) || !this->ctrl->is_row_open(req))
+                    return false;
+                if (per_row) {
+                    int row = this->ctrl->rowtable->get_open_row(req->addr_vec);
+                    return this->ctrl->get_row_reqs(q, req->addr_vec, row) > 0;
+                }
+                if (hit_rowgroups.empty())
+                    return false;
+                AddrVec rowgroup = get_rowgroup(req);
+                for (const auto& hit_rowgroup : hit_rowgroups)
+                    if (rowgroup == hit_rowgroup)
+                        return true;
+                return false;},
+            head_preferred);
+    }
 };
 
-
 // Row Precharge Policy
 template <typename T>
 class RowPolicy
@@ -216,52 +222,78 @@ public:
 
     enum class Type {
         Closed, ClosedAP, Opened, Timeout, MAX
-    } type = Type::Opened;
+    } type = Type::Opened; // set by the "row_policy" config option
 
     int timeout = 50;
 
     RowPolicy(Controller<T>* ctrl) : ctrl(ctrl) {}
 
-    vector<int> get_victim(typename T::Command cmd)
+    static Type parse_type(const string& name)
+    {
+        static const char* names[int(Type::MAX)] = {
+            "Closed", "ClosedAP", "Opened", "Timeout"
+        };
+        for (int i = 0; i < int(Type::MAX); i++)
+            if (name == names[i])
+                return Type(i);
+        cerr << "Invalid row policy: " << name << endl;
+        exit(1);
+    }
+
+    AddrVec get_victim(typename T::Command cmd)
     {
         return policy[int(type)](cmd);
     }
 
+    // The earliest clock at which get_victim() may return a victim
+    long get_next_victim_clk(typename T::Command cmd)
+    {
+        long next_clk = numeric_limits<long>::max();
+        if (type == Type::Opened)
+            return next_clk;
+
+        auto rowtable = this->ctrl->rowtable;
+        for (int id = rowtable->next_open(0); id >= 0; id = rowtable->next_open(id + 1)) {
+            long victim_clk = this->ctrl->channel->get_next(cmd, rowtable->rowgroups[id].data());
+            if (type == Type::Timeout)
+                victim_clk = max(victim_clk, rowtable->table[id].timestamp + timeout);
+            next_clk = min(next_clk, victim_clk);
+        }
+        return next_clk;
+    }
+
 private:
-    function<vector<int>(typename T::Command)> policy[int(Type::MAX)] = {
+    // the first open rowgroup that is ready for cmd and has been open for at
+    // least min_open cycles (only the Timeout policy waits)
+    AddrVec find_victim(typename T::Command cmd, long min_open)
+    {
+        auto rowtable = this->ctrl->rowtable;
+        for (int id = rowtable->next_open(0); id >= 0; id = rowtable->next_open(id + 1)) {
+            if (this->ctrl->clk - rowtable->table[id].timestamp < min_open)
+                continue;
+            if (!this->ctrl->is_ready(cmd, rowtable->rowgroups[id]))
+                continue;
+            return rowtable->rowgroups[id];
+        }
+        return AddrVec();
+    }
+
+    function<AddrVec(typename T::Command)> policy[int(Type::MAX)] = {
         // Closed
-        [this] (typename T::Command cmd) -> vector<int> {
-            for (auto& kv : this->ctrl->rowtable->table) {
-                if (!this->ctrl->is_ready(cmd, kv.first))
-                    continue;
-                return kv.first;
-            }
-            return vector<int>();},
+        [this] (typename T::Command cmd) -> AddrVec {
+            return find_victim(cmd, 0);},
 
         // ClosedAP
-        [this] (typename T::Command cmd) -> vector<int> {
-            for (auto& kv : this->ctrl->rowtable->table) {
-                if (!this->ctrl->is_ready(cmd, kv.first))
-                    continue;
-                return kv.first;
-            }
-            return vector<int>();},
+        [this] (typename T::Command cmd) -> AddrVec {
+            return find_victim(cmd, 0);},
 
         // Opened
         [this] (typename T::Command cmd) {
-            return vector<int>();},
+            return AddrVec();},
 
         // Timeout
-        [this] (typename T::Command cmd) -> vector<int> {
-            for (auto& kv : this->ctrl->rowtable->table) {
-                auto& entry = kv.second;
-                if (this->ctrl->clk - entry.timestamp < timeout)
-                    continue;
-                if (!this->ctrl->is_ready(cmd, kv.first))
-                    continue;
-                return kv.first;
-            }
-            return vector<int>();}
+        [this] (typename T::Command cmd) -> AddrVec {
+            return find_victim(cmd, timeout);}
     };
 
 };
@@ -279,82 +311,137 @@ public:
         long timestamp;
     };
 
-    map<vector<int>, Entry> table;
+    // The rowgroups (banks or subarrays) of the channel are numbered in
+    // address order, so the ids of all rowgroups under a node are contiguous.
+    // The entry of a rowgroup is only valid while its row is open.
+    vector<Entry> table;
+    vector<AddrVec> rowgroups;  // address of each rowgroup (-1 below Row-1)
+    vector<uint64_t> opened;    // bitset of rowgroups with an open row
 
-    RowTable(Controller<T>* ctrl) : ctrl(ctrl) {}
+    RowTable(Controller<T>* ctrl) : ctrl(ctrl)
+    {
+        T* spec = ctrl->channel->spec;
+        const int levels = int(T::Level::Row);
+
+        stride[levels - 1] = 1;
+        for (int l = levels - 2; l >= 0; l--)
+            stride[l] = stride[l + 1] * spec->org_entry.count[l + 1];
+
+        int n = stride[0];
+        table.resize(n);
+        opened.resize((n + 63) / 64);
+        rowgroups.reserve(n);
+        for (int id = 0; id < n; id++) {
+            AddrVec rowgroup(int(T::Level::MAX), -1);
+            rowgroup[0] = ctrl->channel->id;
+            for (int l = 1; l < levels; l++)
+                rowgroup[l] = id / stride[l] % spec->org_entry.count[l];
+            rowgroups.push_back(rowgroup);
+        }
+    }
 
-    void update(typename T::Command cmd, const vector<int>& addr_vec, long clk)
+    void update(typename T::Command cmd, const AddrVec& addr_vec, long clk)
     {
-        auto begin = addr_vec.begin();
-        auto end = begin + int(T::Level::Row);
-        vector<int> rowgroup(begin, end); // bank or subarray
-        int row = *end;
+        int row = addr_vec[int(T::Level::Row)];
 
         T* spec = ctrl->channel->spec;
 
-        if (spec->is_opening(cmd))
-            table.insert({rowgroup, {row, 0, clk}});
+        if (spec->is_opening(cmd)) {
+            int id = get_id(addr_vec);
+            if (!is_open(id)) {
+                set_open(id);
+                table[id] = {row, 0, clk};
+            }
+        }
 
         if (spec->is_accessing(cmd)) {
             // we are accessing a row -- update its entry
-            auto match = table.find(rowgroup);
-            assert(match != table.end());
-            assert(match->second.row == row);
-            match->second.hits++;
-            match->second.timestamp = clk;
+            int id = get_id(addr_vec);
+            assert(is_open(id));
+            assert(table[id].row == row);
+            table[id].hits++;
+            table[id].timestamp = clk;
         } /* accessing */
 
         if (spec->is_closing(cmd)) {
           // we are closing one or more rows -- remove their entries
-          int n_rm = 0;
           int scope;
           if (spec->is_accessing(cmd))
             scope = int(T::Level::Row) - 1; //special condition for RDA and WRA
           else
             scope = int(spec->scope[int(cmd)]);
+          assert(scope < int(T::Level::Row));
 
-          for (auto it = table.begin(); it != table.end();) {
-            if (equal(begin, begin + scope + 1, it->first.begin())) {
-              n_rm++;
-              it = table.erase(it);
-            }
-            else
-              it++;
-          }
-
+          int first = get_id(addr_vec, scope);
+          int n_rm = close(first, first + stride[scope]);
           assert(n_rm > 0);
         } /* closing */
     }
 
-    int get_hits(const vector<int>& addr_vec, const bool to_opened_row = false)
+    int get_hits(const AddrVec& addr_vec, const bool to_opened_row = false)
     {
-        auto begin = addr_vec.begin();
-        auto end = begin + int(T::Level::Row);
-
-        vector<int> rowgroup(begin, end);
-        int row = *end;
-
-        auto itr = table.find(rowgroup);
-        if (itr == table.end())
+        int id = get_id(addr_vec);
+        if (!is_open(id))
             return 0;
 
-        if(!to_opened_row && (itr->second.row != row))
+        if(!to_opened_row && (table[id].row != addr_vec[int(T::Level::Row)]))
             return 0;
 
-        return itr->second.hits;
+        return table[id].hits;
     }
 
-    int get_open_row(const vector<int>& addr_vec) {
-        auto begin = addr_vec.begin();
-        auto end = begin + int(T::Level::Row);
+    int get_open_row(const AddrVec& addr_vec) {
+        int id = get_id(addr_vec);
+        if (!is_open(id))
+            return -1;
 
-        vector<int> rowgroup(begin, end);
+        return table[id].row;
+    }
 
-        auto itr = table.find(rowgroup);
-        if(itr == table.end())
+    // The first rowgroup from id onwards with an open row, or -1 if none
+    int next_open(int id)
+    {
+        int n = table.size();
+        if (id >= n)
             return -1;
+        int word = id / 64;
+        uint64_t bits = opened[word] & (~uint64_t(0) << (id % 64));
+        while (!bits) {
+            if (++word == int(opened.size()))
+                return -1;
+            bits = opened[word];
+        }
+        return word * 64 + __builtin_ctzll(bits);
+    }
 
-        return itr->second.row;
+    // id of the first rowgroup under the node that addr_vec selects at scope
+    int get_id(const AddrVec& addr_vec, int scope = int(T::Level::Row) - 1)
+    {
+        int id = 0;
+        for (int l = 1; l <= scope; l++)
+            id += addr_vec[l] * stride[l];
+        return id;
+    }
+
+private:
+    int stride[int(T::Level::MAX)];  // number of rowgroups under a node of each level
+
+    bool is_open(int id) {return (opened[id / 64] >> (id % 64)) & 1;}
+    void set_open(int id) {opened[id / 64] |= uint64_t(1) << (id % 64);}
+
+    // close the rowgroups in [first, last), and return how many were open
+    int close(int first, int last)
+    {
+        int n = 0;
+        while (first < last) {
+            int bit = first % 64;
+            int width = min(64 - bit, last - first);
+            uint64_t mask = (width == 64) ? ~uint64_t(0) : ((uint64_t(1) << width) - 1) << bit;
+            n += __builtin_popcountll(opened[first / 64] & mask);
+            opened[first / 64] &= ~mask;
+            first += width;
+        }
+        return n;
     }
 };
 
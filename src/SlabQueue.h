@@ -0,0 +1,166 @@
+#ifndef __SLABQUEUE_H
+#define __SLABQUEUE_H
+
+#include <cassert>
+#include <cstddef>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "Request.h"
+
+using namespace std;
+
+namespace ramulator
+{
+
+// An arrival-ordered list of requests stored in a slab of slots that are
+// linked by index. Erasing a request only puts its slot on a free list, so
+// iterators to the other requests stay valid, and once the slab has grown to
+// the queue's capacity no request is ever allocated or freed again.
+class SlabQueue
+{
+    struct Slot {
+        Request req;
+        int prev, next;
+    };
+
+public:
+    class iterator
+    {
+    public:
+        typedef bidirectional_iterator_tag iterator_category;
+        typedef Request value_type;
+        typedef ptrdiff_t difference_type;
+        typedef Request* pointer;
+        typedef Request& reference;
+
+        iterator() : q(nullptr), idx(-1) {}
+        iterator(SlabQueue* q, int idx) : q(q), idx(idx) {}
+
+        Request& operator*() const {return q->slots[idx].req;}
+        Request* operator->() const {return &q->slots[idx].req;}
+        iterator& operator++() {idx = q->slots[idx].next; return *this;}
+        iterator& operator--() {idx = (idx < 0) ? q->tail : q->slots[idx].prev; return *this;}
+        iterator operator++(int) {iterator it = *this; ++*this; return it;}
+        iterator operator--(int) {iterator it = *this; --*this; return it;}
+        bool operator==(const iterator& other) const {return idx == other.idx && q == other.q;}
+        bool operator!=(const iterator& other) const {return !(*this == other);}
+
+        // stable handle of the request within its queue
+        int index() const {return idx;}
+
+    private:
+        SlabQueue* q;
+        int idx;
+    };
+
+    SlabQueue() {}
+    // iterators point back at their queue, so a queue is not copyable
+    SlabQueue(const SlabQueue&) = delete;
+    SlabQueue& operator=(const SlabQueue&) = delete;
+
+    iterator begin() {return iterator(this, head);}
+    iterator end() {return iterator(this, -1);}
+    unsigned int size() const {return count;}
+    bool empty() const {return count == 0;}
+    Request& front() {return slots[head].req;}
+    Request& back() {return slots[tail].req;}
+
+    // preallocate slots for n requests
+    void reserve(unsigned int n)
+    {
+        while (slots.size() < n)
+            release(grow());
+    }
+
+    void push_back(Request&& req)
+    {
+        int idx = acquire();
+        slots[idx].req = move(req);
+    }
+
+    void push_back(const Request& req)
+    {
+        int idx = acquire();
+        slots[idx].req = req;
+    }
+
+    iterator erase(iterator it)
+    {
+        int idx = it.index();
+        assert(idx >= 0);
+        int next = slots[idx].next;
+        unlink(idx);
+        release(idx);
+        return iterator(this, next);
+    }
+
+    void pop_back()
+    {
+        erase(iterator(this, tail));
+    }
+
+    // move a request from another queue to the back of this one
+    void splice_back(SlabQueue& other, iterator it)
+    {
+        push_back(move(*it));
+        other.erase(it);
+    }
+
+private:
+    vector<Slot> slots;
+    int head = -1, tail = -1;  // linked list of requests, in arrival order
+    int free_head = -1;         // singly linked list of unused slots
+    unsigned int count = 0;
+
+    int grow()
+    {
+        slots.emplace_back();
+        return slots.size() - 1;
+    }
+
+    void release(int idx)
+    {
+        slots[idx].next = free_head;
+        free_head = idx;
+    }
+
+    // take a free slot (growing the slab if needed) and link it at the back
+    int acquire()
+    {
+        int idx = free_head;
+        if (idx < 0)
+            idx = grow();
+        else
+            free_head = slots[idx].next;
+
+        slots[idx].prev = tail;
+        slots[idx].next = -1;
+        if (tail < 0)
+            head = idx;
+        else
+            slots[tail].next = idx;
+        tail = idx;
+        count++;
+        return idx;
+    }
+
+    void unlink(int idx)
+    {
+        Slot& slot = slots[idx];
+        if (slot.prev < 0)
+            head = slot.next;
+        else
+            slots[slot.prev].next = slot.next;
+        if (slot.next < 0)
+            tail = slot.prev;
+        else
+            slots[slot.next].prev = slot.prev;
+        count--;
+    }
+};
+
+} /*namespace ramulator*/
+
+#endif /*__SLABQUEUE_H*/
@@ -211,7 +211,7 @@ private:
         }
         // return channel->decode(cmd, req.addr_vec.data());
     }
-    void update(typename T::Command cmd, bool state_change, vector<int>::iterator& begin, vector<int>::iterator& end, request_queue& q){
+    void update(typename T::Command cmd, bool state_change, const int* begin, const int* end, request_queue& q){
         if (q.empty()) return;
 
         for (auto& info : q) {
@@ -0,0 +1,88 @@
+#ifndef __SPSCRING_H
+#define __SPSCRING_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace ramulator
+{
+
+// A bounded queue between exactly one producer thread and one consumer
+// thread. Pushing and popping are lock-free; a side only takes the lock to
+// sleep when the ring is full (producer) or empty (consumer), and the other
+// side only takes it to wake a sleeper up.
+template <typename T>
+class SpscRing
+{
+public:
+    // capacity must be a power of two
+    explicit SpscRing(size_t capacity) : slots(capacity), mask(capacity - 1) {}
+
+    // Blocks while the ring is full. Returns false if the ring was stopped.
+    bool push(const T& item)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == slots.size()) {
+            // sleep until the consumer has made room for a batch of items
+            std::unique_lock<std::mutex> guard(lock);
+            producer_waiting = true;
+            cv.wait(guard, [this, t] {
+                return stopped || t - head.load() <= slots.size() / 2;});
+            producer_waiting = false;
+        }
+        if (stopped)
+            return false;
+        slots[t & mask] = item;
+        tail.store(t + 1);  // seq_cst, so that a waiting consumer is seen
+        if (consumer_waiting)
+            wake();
+        return true;
+    }
+
+    // Blocks while the ring is empty
+    void pop(T& item)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            std::unique_lock<std::mutex> guard(lock);
+            consumer_waiting = true;
+            cv.wait(guard, [this, h] {return h != tail.load();});
+            consumer_waiting = false;
+        }
+        item = slots[h & mask];
+        head.store(h + 1);  // seq_cst, so that a waiting producer is seen
+        if (producer_waiting && tail.load() - (h + 1) <= slots.size() / 2)
+            wake();
+    }
+
+    // makes a blocked (or the next) push return false
+    void stop()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopped = true;
+        cv.notify_all();
+    }
+
+private:
+    std::vector<T> slots;
+    size_t mask;
+    std::atomic<size_t> head{0}, tail{0};  // next item to pop, next slot to push
+
+    std::mutex lock;
+    std::condition_variable cv;
+    std::atomic<bool> producer_waiting{false}, consumer_waiting{false};
+    std::atomic<bool> stopped{false};
+
+    void wake()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        cv.notify_all();
+    }
+};
+
+} /*namespace ramulator*/
+
+#endif /*__SPSCRING_H*/
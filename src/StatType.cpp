@@ -1,5 +1,9 @@
 #include "StatType.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
 namespace Stats {
 
 // Statistics list
@@ -14,6 +18,229 @@ void reset_stats() {
         s->reset();
 }
 
+// The shortest of %.15g and %.17g that reads back as the same value
+static std::string number(Result value) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.15g", value);
+  if (strtod(buf, nullptr) != value) {
+    snprintf(buf, sizeof(buf), "%.17g", value);
+  }
+  return buf;
+}
+
+// {"stats": [{"name": ..., "desc": ..., "value": ..., "elements": [...]}, ...]}
+// Values that are not finite are written as null.
+class JsonStatWriter: public StatWriter {
+ private:
+  bool first = true;
+
+  void quoted(const std::string& str) {
+    file << '"';
+    for (char c : str) {
+      if (c == '"' || c == '\\') {
+        file << '\\' << c;
+      } else if ((unsigned char)c < 0x20) {
+        char buf[8];
+        snprintf(buf, sizeof(buf), "\\u%04x", c);
+        file << buf;
+      } else {
+        file << c;
+      }
+    }
+    file << '"';
+  }
+  void value(Result value) {
+    file << (std::isfinite(value) ? number(value) : "null");
+  }
+
+ public:
+  JsonStatWriter(std::ofstream& file):StatWriter(file){}
+  void begin() {
+    file << "{\"stats\": [";
+  }
+  void stat(const std::string& name, const std::string& desc,
+            Result result, const VResult& elements) {
+    file << (first ? "\n" : ",\n") << "  {\"name\": ";
+    first = false;
+    quoted(name);
+    file << ", \"desc\": ";
+    quoted(desc);
+    file << ", \"value\": ";
+    value(result);
+    if (!elements.empty()) {
+      file << ", \"elements\": [";
+      for (off_type i = 0 ; i < elements.size() ; ++i) {
+        file << (i ? ", " : "");
+        value(elements[i]);
+      }
+      file << "]";
+    }
+    file << "}";
+  }
+  void end() {
+    file << "\n]}\n";
+  }
+};
+
+// A name,value,elements,description row per stat. The elements of a vector
+// stat are separated by spaces; the description is quoted.
+class CsvStatWriter: public StatWriter {
+ public:
+  CsvStatWriter(std::ofstream& file):StatWriter(file){}
+  void begin() {
+    file << "name,value,elements,description\n";
+  }
+  void stat(const std::string& name, const std::string& desc,
+            Result value, const VResult& elements) {
+    file << name << ',' << number(value) << ',';
+    for (off_type i = 0 ; i < elements.size() ; ++i) {
+      file << (i ? " " : "") << number(elements[i]);
+    }
+    file << ",\"";
+    for (char c : desc) {
+      file << (c == '"' ? "\"\"" : std::string(1, c));
+    }
+    file << "\"\n";
+  }
+};
+
+// Columns of little-endian values, so that a sweep can read a run's values
+// without parsing its names:
+//   "RAMSTATS", u32 version, u32 stats, u32 elements, u32 0  (24 bytes)
+//   f64 value per stat
+//   f64 element values, the elements of each vector stat in turn
+//   u32 element count per stat
+//   NUL-terminated name per stat
+//   NUL-terminated description per stat
+// The columns are gathered as the list is walked and written at its end.
+class BinaryStatWriter: public StatWriter {
+ private:
+  static const uint32_t version = 1;
+
+  VResult values;
+  VResult element_values;
+  std::vector<uint32_t> element_counts;
+  std::string names;
+  std::string descs;
+
+  void put(uint64_t value, int n) {
+    for (int i = 0 ; i < n ; ++i, value >>= 8) {
+      file.put(char(value & 0xff));
+    }
+  }
+  void put(const VResult& column) {
+    for (Result value : column) {
+      uint64_t bits;
+      memcpy(&bits, &value, sizeof(bits));
+      put(bits, 8);
+    }
+  }
+
+ public:
+  BinaryStatWriter(std::ofstream& file):StatWriter(file){}
+  void stat(const std::string& name, const std::string& desc,
+            Result value, const VResult& elements) {
+    values.push_back(value);
+    element_values.insert(element_values.end(), elements.begin(), elements.end());
+    element_counts.push_back(elements.size());
+    names.append(name.c_str(), name.size() + 1);
+    descs.append(desc.c_str(), desc.size() + 1);
+  }
+  void end() {
+    file.write("RAMSTATS", 8);
+    put(version, 4);
+    put(values.size(), 4);
+    put(element_values.size(), 4);
+    put(0, 4);
+    put(values);
+    put(element_values);
+    for (uint32_t count : element_counts) {
+      put(count, 4);
+    }
+    file.write(names.data(), names.size());
+    file.write(descs.data(), descs.size());
+  }
+};
+
+StatWriter* StatWriter::create(const std::string& format, std::ofstream& file) {
+  if (format == "json") {
+    return new JsonStatWriter(file);
+  } else if (format == "csv") {
+    return new CsvStatWriter(file);
+  } else if (format == "binary") {
+    return new BinaryStatWriter(file);
+  }
+  return nullptr;
+}
+
+EpochStats::EpochStats(const std::string& filename, const std::string& prefixes, long length,
+                       std::function<void()> update)
+    : length(length), update(update), next_cycle(length) {
+  if (!length) {
+    return;
+  }
+  std::vector<std::string> starts;
+  for (size_t start = 0, end; start <= prefixes.size(); start = end + 1) {
+    end = std::min(prefixes.find(',', start), prefixes.size());
+    if (end > start) {
+      starts.push_back(prefixes.substr(start, end - start));
+    }
+  }
+  for (StatBase* stat : statlist.stats()) {
+    if (!stat || !stat->is_display()) {
+      continue;
+    }
+    for (const std::string& start : starts) {
+      if (stat->name().compare(0, start.size(), start) == 0) {
+        stats.push_back(stat);
+        break;
+      }
+    }
+  }
+
+  file.open(filename.c_str(), std::ios_base::out);
+  if (!file.good()) {
+    assert(false && "!file.good()");
+  }
+  file << "cycle,cycles";
+  for (StatBase* stat : stats) {
+    current.clear();
+    stat->counters(current);
+    for (off_type i = 0 ; i < current.size() ; ++i) {
+      file << ',' << stat->name();
+      if (i) {
+        file << '[' << i - 1 << ']';
+      }
+    }
+  }
+  file << '\n';
+
+  if (update) {
+    update();
+  }
+  last.clear();
+  for (StatBase* stat : stats) {
+    stat->counters(last);
+  }
+}
+
+void EpochStats::snapshot(long cycle) {
+  if (update) {
+    update();
+  }
+  current.clear();
+  for (StatBase* stat : stats) {
+    stat->counters(current);
+  }
+  file << cycle << ',' << cycle - last_cycle;
+  for (off_type i = 0 ; i < current.size() ; ++i) {
+    file << ',' << number(current[i] - last[i]);
+  }
+  file << '\n';
+  last.swap(current);
+  last_cycle = cycle;
+}
+
 void
 Histogram::grow_out()
 {
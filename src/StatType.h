@@ -3,6 +3,8 @@
 
 #include <limits>
 #include <fstream>
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -60,6 +62,24 @@ class Flags {
   bool is_display() const {return flags & display;}
 };
 
+// Writes the displayed stats of a StatList in a machine-readable format,
+// one stat at a time as the list is walked
+class StatWriter {
+ protected:
+  std::ofstream& file;
+ public:
+  // json, csv or binary; nullptr for any other format
+  static StatWriter* create(const std::string& format, std::ofstream& file);
+
+  StatWriter(std::ofstream& file):file(file){}
+  virtual ~StatWriter() {}
+  virtual void begin() {}
+  // elements is empty but for vector stats
+  virtual void stat(const std::string& name, const std::string& desc,
+                    Result value, const VResult& elements) = 0;
+  virtual void end() {}
+};
+
 class StatBase {
  public:
     StatBase() {
@@ -70,6 +90,12 @@ class StatBase {
   // TODO implement print for Distribution, Histogram,
   // AverageDeviation, StandardDeviation
   virtual void print(std::ofstream& file) = 0;
+  virtual void write(StatWriter& writer) {}
+  virtual const std::string& name() const = 0;
+  // Appends the running totals behind the stat's result, which can be read
+  // at any time without prepare(): one value, or the total and each element
+  // of a vector. Stats without totals append nothing.
+  virtual void counters(VCounter& values) const {}
 
   virtual size_type size() const = 0;
   virtual bool zero() const = 0;
@@ -87,17 +113,32 @@ class StatList {
  protected:
   std::vector<StatBase*> list;
   std::ofstream stat_output;
+  std::unique_ptr<StatWriter> writer;  // none for the text format
  public:
   void add(StatBase* stat) {
     list.push_back(stat);
   }
-  void output(std::string filename) {
-    stat_output.open(filename.c_str(), std::ios_base::out);
+  const std::vector<StatBase*>& stats() const {
+    return list;
+  }
+  // Returns false if the format is unknown
+  bool output(std::string filename, const std::string& format = "text") {
+    if (format != "text") {
+      writer.reset(StatWriter::create(format, stat_output));
+      if (!writer) {
+        return false;
+      }
+    }
+    stat_output.open(filename.c_str(), std::ios_base::out | std::ios_base::binary);
     if (!stat_output.good()) {
       assert(false && "!stat_output.good()");
     }
+    return true;
   }
   void printall() {
+    if (writer) {
+      writer->begin();
+    }
     for(off_type i = 0 ; i < list.size() ; ++i) {
       if (!list[i]) {
         continue;
@@ -107,9 +148,16 @@ class StatList {
       }
       if (list[i]->is_display()) {
         list[i]->prepare();
-        list[i]->print(stat_output);
+        if (writer) {
+          list[i]->write(*writer);
+        } else {
+          list[i]->print(stat_output);
+        }
       }
     }
+    if (writer) {
+      writer->end();
+    }
   }
   ~StatList() {
     stat_output.close();
@@ -118,6 +166,52 @@ class StatList {
 
 extern StatList statlist;
 
+// Appends how much the selected stats changed over every epoch of a clock to
+// a time-series file, a CSV row per epoch:
+//   cycle,cycles,<stat>,<vector stat>,<vector stat>[0],...
+// where cycle ends the epoch and cycles is its length. Only the stats'
+// running totals are read, so a snapshot costs a copy of the selected
+// counters. Averages change by the sum of their value over the epoch's
+// cycles, like the *_sum stats.
+class EpochStats {
+ private:
+  long length;     // cycles per epoch, or 0 for none
+  std::function<void()> update;
+  long last_cycle = 0;
+  long next_cycle;
+  std::ofstream file;
+  std::vector<StatBase*> stats;
+  VCounter last;
+  VCounter current;
+
+ public:
+  // prefixes: a comma-separated list, of which a displayed stat's name must
+  // start with one to be recorded
+  // update: brings stats that are only computed on demand up to date before
+  // each snapshot
+  EpochStats(const std::string& filename, const std::string& prefixes, long length,
+             std::function<void()> update = nullptr);
+
+  // Cycles until the current epoch ends
+  long left(long cycle) const {
+    return length ? next_cycle - cycle : std::numeric_limits<long>::max();
+  }
+  // Call after every cycle of the epoch's clock
+  void tick(long cycle) {
+    if (length && cycle >= next_cycle) {
+      snapshot(cycle);
+      next_cycle = cycle + length;
+    }
+  }
+  // Records the last, partial epoch
+  void finish(long cycle) {
+    if (length && cycle > last_cycle) {
+      snapshot(cycle);
+    }
+  }
+  void snapshot(long cycle);
+};
+
 template<class Derived>
 class Stat : public StatBase {
  protected:
@@ -136,6 +230,7 @@ class Stat : public StatBase {
     _name = __name;
     return self();
   };
+  const std::string& name() const {return _name;}
   Derived &desc(const std::string &__desc) {
     _desc = __desc;
     return self();
@@ -193,6 +288,9 @@ class ScalarBase: public Stat<ScalarType> {
 
   size_type size() const {return 1;}
   VResult vresult() const {return VResult(1, result());}
+  void counters(VCounter& values) const {
+    values.push_back(value());
+  }
 
   virtual void print(std::ofstream& file) {
     Stat<ScalarType>::printname(file);
@@ -203,6 +301,11 @@ class ScalarBase: public Stat<ScalarType> {
     file << std::fixed << res;
     Stat<ScalarType>::printdesc(file);
   }
+
+  void write(StatWriter& writer) {
+    writer.stat(Stat<ScalarType>::_name, Stat<ScalarType>::_desc,
+                Stat<ScalarType>::self().result(), VResult());
+  }
 };
 
 class ConstValue: public ScalarBase<ConstValue> {
@@ -313,6 +416,10 @@ class Average: public ScalarBase<Average> {
   }
 
   Counter value() const { return current; }
+  // the sum of the value over every cycle so far
+  void counters(VCounter& values) const {
+    values.push_back(total_val + current * (curTick - last));
+  }
   Result result() const {
     assert(last == curTick);
     return (Result)(total_val + current)/ (Result)(curTick - lastReset + 1);
@@ -382,6 +489,15 @@ class VectorBase: public Stat<Derived> {
     return (fabs(total()) < eps);
   }
 
+  void counters(VCounter& values) const {
+    size_t first = values.size();
+    values.push_back(0.0);
+    for (off_type i = 0 ; i < size() ; ++i) {
+      data[i].counters(values);
+      values[first] += values.back();
+    }
+  }
+
   void prepare() {
     for (off_type i = 0 ; i < size() ; ++i) {
       data[i].prepare();
@@ -402,6 +518,11 @@ class VectorBase: public Stat<Derived> {
       data[i].print(file);
     }
   }
+  void write(StatWriter& writer) {
+    VResult elements;
+    result(elements);
+    writer.stat(Stat<Derived>::_name, Stat<Derived>::_desc, total(), elements);
+  }
 };
 
 class Vector: public VectorBase<Vector, Scalar> {
@@ -0,0 +1,290 @@
+#ifndef __TRACEFORMAT_H
+#define __TRACEFORMAT_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <streambuf>
+#include <vector>
+
+namespace ramulator
+{
+
+// Binary trace format, converted from the text formats by tracetool.
+//
+// A 32-byte little-endian header:
+//   char[8]   magic "RAMTRACE"
+//   uint32    version
+//   uint32    kind (TraceHeader::Kind), which must match the simulation mode
+//   uint32[2] reserved
+//   uint64    number of records
+// followed by one record per line of the text trace:
+//   varint    bubble_cnt << 2 | has_writeback << 1 | is_write
+//   varint    zigzag(addr - addr of the previous record)
+//   varint    zigzag(writeback addr - addr), only if has_writeback
+// Varints hold 7 bits per byte, least significant first, with the top bit
+// set on every byte but the last.
+
+struct TraceRecord
+{
+    long bubble_cnt = 0;
+    long addr = 0;
+    bool is_write = false;
+    bool has_writeback = false;
+    long writeback_addr = 0;
+};
+
+// Fixed-width little-endian fields of the headers below
+struct LittleEndian
+{
+    static uint64_t get(const unsigned char* p, int n)
+    {
+        uint64_t value = 0;
+        for (int i = n - 1; i >= 0; i--)
+            value = value << 8 | p[i];
+        return value;
+    }
+    static void put(unsigned char* p, int n, uint64_t value)
+    {
+        for (int i = 0; i < n; i++, value >>= 8)
+            p[i] = value & 0xff;
+    }
+};
+
+struct TraceHeader
+{
+    static const int size = 32;
+    static const uint32_t current_version = 1;
+
+    enum class Kind : uint32_t {
+        CPU,   // <num-cpuinst> <addr> [<addr-writeback> | R | W]
+        DRAM,  // <addr> <R|W>
+        TimedDRAM,  // <cycle> <addr(hex)> <R|W>, the cycle kept as bubble_cnt
+        MAX
+    };
+
+    uint32_t version = current_version;
+    Kind kind = Kind::CPU;
+    uint64_t records = 0;
+
+    static const char* magic() {return "RAMTRACE";}
+
+    // Returns false (and consumes at most size bytes) if the stream does not
+    // start with a binary trace header
+    bool read(std::istream& in)
+    {
+        unsigned char buf[size];
+        if (!in.read((char*)buf, size) || memcmp(buf, magic(), 8))
+            return false;
+        version = LittleEndian::get(buf + 8, 4);
+        kind = Kind(LittleEndian::get(buf + 12, 4));
+        records = LittleEndian::get(buf + 24, 8);
+        return true;
+    }
+
+    void write(std::ostream& out) const
+    {
+        unsigned char buf[size] = {};
+        memcpy(buf, magic(), 8);
+        LittleEndian::put(buf + 8, 4, version);
+        LittleEndian::put(buf + 12, 4, uint32_t(kind));
+        LittleEndian::put(buf + 24, 8, records);
+        out.write((const char*)buf, size);
+    }
+};
+
+// Encodes records, which must be written in trace order
+class TraceEncoder
+{
+public:
+    void put(std::ostream& out, const TraceRecord& record)
+    {
+        put_varint(out, uint64_t(record.bubble_cnt) << 2
+                | uint64_t(record.has_writeback) << 1 | uint64_t(record.is_write));
+        put_varint(out, zigzag(record.addr - prev_addr));
+        if (record.has_writeback)
+            put_varint(out, zigzag(record.writeback_addr - record.addr));
+        prev_addr = record.addr;
+    }
+
+private:
+    long prev_addr = 0;
+
+    static uint64_t zigzag(long delta)
+    {
+        return (uint64_t(delta) << 1) ^ uint64_t(delta >> 63);
+    }
+    static void put_varint(std::ostream& out, uint64_t value)
+    {
+        char buf[10];
+        int n = 0;
+        while (value >= 0x80) {
+            buf[n++] = char(value | 0x80);
+            value >>= 7;
+        }
+        buf[n++] = char(value);
+        out.write(buf, n);
+    }
+};
+
+// Decodes the records that follow the header, in trace order
+class TraceDecoder
+{
+public:
+    // Returns false at the end of the stream or on a truncated record
+    bool get(std::streambuf& in, TraceRecord& record)
+    {
+        uint64_t head, delta;
+        if (!get_varint(in, head) || !get_varint(in, delta))
+            return false;
+        record.bubble_cnt = long(head >> 2);
+        record.has_writeback = head & 2;
+        record.is_write = head & 1;
+        record.addr = prev_addr + unzigzag(delta);
+        if (record.has_writeback) {
+            if (!get_varint(in, delta))
+                return false;
+            record.writeback_addr = record.addr + unzigzag(delta);
+        }
+        prev_addr = record.addr;
+        return true;
+    }
+
+    // start over from the first record, or from the record after one at
+    // address prev_addr
+    void reset(long prev_addr = 0) {this->prev_addr = prev_addr;}
+    long last_addr() const {return prev_addr;}
+
+private:
+    long prev_addr = 0;
+
+    static long unzigzag(uint64_t value)
+    {
+        return long(value >> 1) ^ -long(value & 1);
+    }
+    static bool get_varint(std::streambuf& in, uint64_t& value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            int c = in.sbumpc();
+            if (c == std::streambuf::traits_type::eof())
+                return false;
+            value |= uint64_t(c & 0x7f) << shift;
+            if (!(c & 0x80))
+                return true;
+        }
+        return false;
+    }
+};
+
+// Index of a trace (text or binary, possibly compressed), which tracetool
+// writes next to it as <trace>.idx. A 32-byte little-endian header:
+//   char[8]   magic "RAMTRIDX"
+//   uint32    version
+//   uint32    interval: records between entries
+//   uint64    size of the trace file, to tell a stale index
+//   uint64    number of entries
+// followed by an entry for every interval-th record, from the first:
+//   uint64    instructions before the record
+//   uint64    byte offset of the record in the (uncompressed) trace
+//   uint64    records before the record
+//   int64     address of the previous record (see TraceDecoder::reset)
+// A record counts as bubble_cnt + 1 instructions, plus one for a writeback,
+// as the cores retire them; each request of a memory trace counts as one.
+struct TraceIndex
+{
+    static const int header_size = 32;
+    static const int entry_size = 32;
+    static const uint32_t current_version = 1;
+
+    struct Entry {
+        uint64_t insts = 0;
+        uint64_t offset = 0;
+        uint64_t records = 0;
+        int64_t prev_addr = 0;
+    };
+
+    uint32_t version = current_version;
+    uint32_t interval = 0;
+    uint64_t trace_size = 0;
+    std::vector<Entry> entries;
+
+    static const char* magic() {return "RAMTRIDX";}
+
+    static uint64_t insts(const TraceRecord& record)
+    {
+        return record.bubble_cnt + 1 + record.has_writeback;
+    }
+
+    // The last entry at or before instruction insts, or nullptr
+    const Entry* find(uint64_t insts) const
+    {
+        auto it = std::upper_bound(entries.begin(), entries.end(), insts,
+            [] (uint64_t insts, const Entry& e) {return insts < e.insts;});
+        return it == entries.begin() ? nullptr : &*(it - 1);
+    }
+
+    // Fails on a truncated or corrupt index: the entries must fill the rest
+    // of the file exactly, in the order of the trace. Only the header of an
+    // index of another version is read.
+    bool read(std::istream& in)
+    {
+        unsigned char buf[header_size];
+        if (!in.read((char*)buf, header_size) || memcmp(buf, magic(), 8))
+            return false;
+        version = LittleEndian::get(buf + 8, 4);
+        interval = LittleEndian::get(buf + 12, 4);
+        trace_size = LittleEndian::get(buf + 16, 8);
+        uint64_t count = LittleEndian::get(buf + 24, 8);
+        if (version != current_version)
+            return true;  // the caller tells it is stale
+
+        std::streampos start = in.tellg();
+        in.seekg(0, std::ios::end);
+        std::streamoff left = in.tellg() - start;
+        in.seekg(start);
+        if (!in || left < 0 || count != uint64_t(left) / entry_size
+                || uint64_t(left) % entry_size)
+            return false;
+
+        entries.resize(count);
+        const Entry* prev = nullptr;
+        for (auto& e : entries) {
+            if (!in.read((char*)buf, entry_size))
+                return false;
+            e.insts = LittleEndian::get(buf, 8);
+            e.offset = LittleEndian::get(buf + 8, 8);
+            e.records = LittleEndian::get(buf + 16, 8);
+            e.prev_addr = int64_t(LittleEndian::get(buf + 24, 8));
+            if (prev && (e.insts < prev->insts || e.offset < prev->offset
+                    || e.records < prev->records))
+                return false;
+            prev = &e;
+        }
+        return true;
+    }
+
+    void write(std::ostream& out) const
+    {
+        unsigned char buf[header_size] = {};
+        memcpy(buf, magic(), 8);
+        LittleEndian::put(buf + 8, 4, version);
+        LittleEndian::put(buf + 12, 4, interval);
+        LittleEndian::put(buf + 16, 8, trace_size);
+        LittleEndian::put(buf + 24, 8, entries.size());
+        out.write((const char*)buf, header_size);
+        for (auto& e : entries) {
+            LittleEndian::put(buf, 8, e.insts);
+            LittleEndian::put(buf + 8, 8, e.offset);
+            LittleEndian::put(buf + 16, 8, e.records);
+            LittleEndian::put(buf + 24, 8, uint64_t(e.prev_addr));
+            out.write((const char*)buf, entry_size);
+        }
+    }
+};
+
+} /*namespace ramulator*/
+
+#endif /*__TRACEFORMAT_H*/
@@ -0,0 +1,352 @@
+#include "TraceSource.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#ifdef RAMULATOR_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace std;
+using namespace ramulator;
+
+TraceSource* TraceSource::open(const string& fname)
+{
+    FILE* file = fopen(fname.c_str(), "rb");
+    if (!file)
+        return nullptr;
+
+    unsigned char magic[4] = {};
+    size_t n = fread(magic, 1, sizeof(magic), file);
+    if (n >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) {
+        fclose(file);
+        return new DecompressSource(fname, DecompressSource::Codec::Gzip);
+    }
+    if (n == 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) {
+        fclose(file);
+        return new DecompressSource(fname, DecompressSource::Codec::Zstd);
+    }
+
+    struct stat st;
+    if (fstat(fileno(file), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+        if (data != MAP_FAILED) {
+            fclose(file);  // the mapping outlives the descriptor
+            return new MmapSource(static_cast<char*>(data), st.st_size);
+        }
+    }
+    if (fseek(file, 0, SEEK_SET) != 0)
+        return new FileSource(file, reinterpret_cast<char*>(magic), n);
+    return new FileSource(file);
+}
+
+void TraceSource::seek(uint64_t offset)
+{
+    rewind();
+    while (offset) {
+        if (sgetc() == traits_type::eof())
+            return;
+        uint64_t n = std::min<uint64_t>(offset, egptr() - gptr());
+        gbump(int(n));
+        offset -= n;
+    }
+}
+
+MmapSource::MmapSource(char* data, size_t size) : data(data), size(size)
+{
+    // read ahead aggressively, and drop pages soon after they are read
+    madvise(data, size, MADV_SEQUENTIAL);
+    rewind();
+}
+
+MmapSource::~MmapSource()
+{
+    munmap(data, size);
+}
+
+void MmapSource::rewind()
+{
+    setg(data, data, data + size);
+}
+
+uint64_t MmapSource::tell()
+{
+    return gptr() - data;
+}
+
+void MmapSource::seek(uint64_t offset)
+{
+    setg(data, data + std::min<uint64_t>(offset, size), data + size);
+}
+
+FileSource::FileSource(FILE* file, const char* head, size_t n)
+    : file(file), block(1 << 16)
+{
+    copy(head, head + n, block.data());
+    if (n)
+        n += fread(block.data() + n, 1, block.size() - n, file);
+    setg(block.data(), block.data(), block.data() + n);
+}
+
+FileSource::~FileSource()
+{
+    fclose(file);
+}
+
+void FileSource::rewind()
+{
+    if (fseek(file, 0, SEEK_SET) == 0) {
+        block_offset = 0;
+        setg(nullptr, nullptr, nullptr);
+    } else if (block_offset == 0) {  // a pipe can only go back within its first block
+        setg(eback(), eback(), egptr());
+    } else {
+        // reported if the trace is read again, as a pipe ends it for good
+        rewind_failed = true;
+        setg(nullptr, nullptr, nullptr);
+    }
+}
+
+uint64_t FileSource::tell()
+{
+    return block_offset + (gptr() - eback());
+}
+
+void FileSource::seek(uint64_t offset)
+{
+    if (fseek(file, offset, SEEK_SET) == 0) {
+        block_offset = offset;
+        setg(nullptr, nullptr, nullptr);
+    } else {
+        TraceSource::seek(offset);
+    }
+}
+
+FileSource::int_type FileSource::underflow()
+{
+    if (rewind_failed) {
+        cerr << "Cannot read the trace again: it is not a regular file, and it was read past its first block" << endl;
+        exit(1);
+    }
+    block_offset += egptr() - eback();
+    size_t n = fread(block.data(), 1, block.size(), file);
+    setg(block.data(), block.data(), block.data() + n);
+    if (!n)
+        return traits_type::eof();
+    return traits_type::to_int_type(*gptr());
+}
+
+class DecompressSource::Decoder
+{
+public:
+    virtual ~Decoder() {}
+    // Fills out with up to n bytes; returns how many, 0 at the end of the
+    // file or -1 on a corrupt file
+    virtual long read(char* out, size_t n) = 0;
+};
+
+namespace
+{
+
+class GzipDecoder : public DecompressSource::Decoder
+{
+public:
+    explicit GzipDecoder(gzFile file) : file(file) {gzbuffer(file, 1 << 17);}
+    ~GzipDecoder() {gzclose(file);}
+
+    // gzread also handles concatenated gzip members
+    long read(char* out, size_t n)
+    {
+        long got = gzread(file, out, unsigned(n));
+        int error = Z_OK;
+        if (got == 0)  // a truncated file ends early with Z_BUF_ERROR
+            gzerror(file, &error);
+        return error == Z_OK ? got : -1;
+    }
+
+private:
+    gzFile file;
+};
+
+#ifdef RAMULATOR_ZSTD
+class ZstdDecoder : public DecompressSource::Decoder
+{
+public:
+    explicit ZstdDecoder(FILE* file)
+        : file(file), stream(ZSTD_createDStream()), in(ZSTD_DStreamInSize())
+    {
+        ZSTD_initDStream(stream);
+        input = {in.data(), 0, 0};
+    }
+    ~ZstdDecoder()
+    {
+        ZSTD_freeDStream(stream);
+        fclose(file);
+    }
+
+    long read(char* out, size_t n)
+    {
+        ZSTD_outBuffer output = {out, n, 0};
+        while (output.pos < output.size) {
+            if (input.pos == input.size) {
+                input.size = fread(in.data(), 1, in.size(), file);
+                input.pos = 0;
+                if (!input.size)
+                    break;
+            }
+            left = ZSTD_decompressStream(stream, &output, &input);
+            if (ZSTD_isError(left))
+                return -1;
+        }
+        // the file ended within a frame
+        if (output.pos == 0 && left != 0)
+            return -1;
+        return output.pos;
+    }
+
+private:
+    FILE* file;
+    ZSTD_DStream* stream;
+    vector<char> in;
+    ZSTD_inBuffer input;
+    size_t left = 0;  // the last hint of ZSTD_decompressStream, 0 after a frame
+};
+#endif
+
+} /*namespace*/
+
+DecompressSource::DecompressSource(const string& fname, Codec codec)
+    : fname(fname), codec(codec)
+{
+#ifndef RAMULATOR_ZSTD
+    if (codec == Codec::Zstd) {
+        cerr << "Ramulator was built without zstd support (make ZSTD=1): " << fname << endl;
+        exit(1);
+    }
+#endif
+    start();
+}
+
+DecompressSource::~DecompressSource()
+{
+    stop();
+}
+
+void DecompressSource::rewind()
+{
+    stop();
+    start();
+}
+
+uint64_t DecompressSource::tell()
+{
+    return current_offset + (gptr() - eback());
+}
+
+void DecompressSource::start()
+{
+    Decoder* decoder = nullptr;
+    if (codec == Codec::Gzip) {
+        gzFile file = gzopen(fname.c_str(), "rb");
+        if (file)
+            decoder = new GzipDecoder(file);
+    }
+#ifdef RAMULATOR_ZSTD
+    if (codec == Codec::Zstd) {
+        FILE* file = fopen(fname.c_str(), "rb");
+        if (file)
+            decoder = new ZstdDecoder(file);
+    }
+#endif
+    if (!decoder) {
+        cerr << "Bad trace file: " << fname << endl;
+        exit(1);
+    }
+
+    done = stopping = corrupt = false;
+    current_offset = 0;
+    worker = thread([this, decoder] () {
+        unique_ptr<Decoder> owner(decoder);
+        this->run(*owner);
+    });
+}
+
+void DecompressSource::stop()
+{
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    cv.notify_all();
+    worker.join();
+
+    for (auto& chunk : ready)
+        spare.push_back(move(chunk));
+    ready.clear();
+    setg(nullptr, nullptr, nullptr);
+}
+
+void DecompressSource::run(Decoder& decoder)
+{
+    while (true) {
+        vector<char> chunk;
+        {
+            unique_lock<mutex> guard(lock);
+            cv.wait(guard, [this] {return stopping || ready.size() < max_chunks;});
+            if (stopping)
+                return;
+            if (!spare.empty()) {
+                chunk.swap(spare.back());
+                spare.pop_back();
+            }
+        }
+
+        chunk.resize(chunk_size);
+        long n = decoder.read(chunk.data(), chunk_size);
+        if (n < 0) {
+            corrupt = true;  // reported by the reader once it gets here
+            n = 0;
+        }
+        chunk.resize(n);
+
+        {
+            lock_guard<mutex> guard(lock);
+            if (n)
+                ready.push_back(move(chunk));
+            else
+                done = true;
+        }
+        cv.notify_all();
+        if (!n)
+            return;
+    }
+}
+
+DecompressSource::int_type DecompressSource::underflow()
+{
+    current_offset += egptr() - eback();
+    unique_lock<mutex> guard(lock);
+    if (current.capacity()) {
+        spare.push_back(move(current));
+        current = vector<char>();
+    }
+    cv.wait(guard, [this] {return !ready.empty() || done;});
+    if (ready.empty() && corrupt) {
+        cerr << "Corrupt compressed trace file: " << fname << endl;
+        exit(1);
+    }
+    if (ready.empty()) {
+        setg(nullptr, nullptr, nullptr);
+        return traits_type::eof();
+    }
+    current = move(ready.front());
+    ready.pop_front();
+    guard.unlock();
+    cv.notify_all();
+
+    setg(current.data(), current.data(), current.data() + current.size());
+    return traits_type::to_int_type(*gptr());
+}
@@ -0,0 +1,120 @@
+#ifndef __TRACESOURCE_H
+#define __TRACESOURCE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ramulator
+{
+
+// The bytes of a trace file, read through the std::streambuf interface so
+// that both the text and the binary readers of Trace can consume them.
+class TraceSource : public std::streambuf
+{
+public:
+    // Opens a plain, gzip or zstd compressed file, as told by its first
+    // bytes. Returns nullptr if the file cannot be read.
+    static TraceSource* open(const std::string& fname);
+
+    virtual ~TraceSource() {}
+
+    // start over from the first byte of the (uncompressed) trace
+    virtual void rewind() = 0;
+
+    // The offset of the next byte in the (uncompressed) trace
+    virtual uint64_t tell() = 0;
+    // Continues from a tell() offset. By default, the trace is read again
+    // up to it.
+    virtual void seek(uint64_t offset);
+};
+
+// An uncompressed file, mapped into memory as a whole. The trace is parsed
+// from the page cache itself, which concurrent simulations of the same trace
+// share, and rewinding is free.
+class MmapSource : public TraceSource
+{
+public:
+    MmapSource(char* data, size_t size);
+    ~MmapSource();
+    void rewind();
+    uint64_t tell();
+    void seek(uint64_t offset);
+
+private:
+    char* data;
+    size_t size;
+};
+
+// An uncompressed file that cannot be mapped (e.g., a pipe), read in large
+// blocks
+class FileSource : public TraceSource
+{
+public:
+    // head: bytes already read from a file that cannot seek back to them
+    FileSource(FILE* file, const char* head = nullptr, size_t n = 0);
+    ~FileSource();
+    void rewind();
+    uint64_t tell();
+    void seek(uint64_t offset);
+
+protected:
+    int_type underflow();
+
+private:
+    FILE* file;
+    std::vector<char> block;
+    uint64_t block_offset = 0;  // where block starts in the file
+    bool rewind_failed = false;
+};
+
+// A compressed file, decompressed ahead of the reader by a background
+// thread into a bounded number of chunks
+class DecompressSource : public TraceSource
+{
+public:
+    enum class Codec {Gzip, Zstd};
+    class Decoder;  // inflates the file, a block at a time
+
+    DecompressSource(const std::string& fname, Codec codec);
+    ~DecompressSource();
+    // The compressed stream cannot seek, so the file is reopened
+    void rewind();
+    uint64_t tell();
+
+protected:
+    int_type underflow();
+
+private:
+    static const size_t chunk_size = 1 << 18;
+    static const size_t max_chunks = 4;
+
+    std::string fname;
+    Codec codec;
+
+    std::thread worker;
+    std::mutex lock;
+    std::condition_variable cv;
+    std::deque<std::vector<char>> ready;  // decompressed chunks, in order
+    std::vector<std::vector<char>> spare; // emptied chunks, for reuse
+    std::vector<char> current;            // chunk being read
+    uint64_t current_offset = 0;          // where current starts in the trace
+    bool done = false;      // the worker has produced its last chunk
+    bool corrupt = false;   // the worker stopped at bad compressed data
+    bool stopping = false;  // the worker should quit early
+
+    void start();
+    void stop();
+    void run(Decoder& decoder);
+};
+
+} /*namespace ramulator*/
+
+#endif /*__TRACESOURCE_H*/
@@ -0,0 +1,222 @@
+// Converts text traces to the binary trace format of TraceFormat.h, and
+// indexes traces for trace_skip_insts.
+//
+//   tracetool convert [--timed] <text trace> <binary trace>
+//   tracetool index <trace> [records between entries]
+//
+// A text trace may be a CPU trace (<num-cpuinst> <addr> [<addr-writeback> | R | W])
+// or a memory trace (<addr> <R|W>); the kind is taken from its first line.
+// Either may be compressed, like the traces that Ramulator reads. A timed
+// memory trace (<cycle> <addr(hex)> <R|W>, see trace_timestamps) reads like a
+// CPU trace with a decimal address, so it has to be named with --timed.
+// The index of <trace> is written to <trace>.idx.
+
+#include "TraceFormat.h"
+#include "TraceSource.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <sys/stat.h>
+
+using namespace std;
+using namespace ramulator;
+
+static const char* skip_spaces(const char* p)
+{
+    while (*p == ' ' || *p == '\t')
+        p++;
+    return p;
+}
+
+static bool is_type(const char* p)
+{
+    return (*p == 'R' || *p == 'W') && !isalnum(p[1]);
+}
+
+// Parses one line into record, following the text readers of Trace
+static bool parse_line(const char* line, TraceHeader::Kind kind, TraceRecord& record)
+{
+    char* end;
+    record = TraceRecord();
+    if (kind == TraceHeader::Kind::DRAM) {
+        record.addr = strtoul(line, &end, 16);
+        const char* p = skip_spaces(end);
+        if (end == line || !is_type(p))
+            return false;
+        record.is_write = (*p == 'W');
+        return true;
+    }
+    if (kind == TraceHeader::Kind::TimedDRAM) {
+        record.bubble_cnt = strtoul(line, &end, 10);
+        const char* p = skip_spaces(end);
+        if (end == line)
+            return false;
+        record.addr = strtoul(p, &end, 16);
+        if (end == p)
+            return false;
+        p = skip_spaces(end);
+        if (!is_type(p))
+            return false;
+        record.is_write = (*p == 'W');
+        return true;
+    }
+
+    record.bubble_cnt = strtoul(line, &end, 10);
+    const char* p = skip_spaces(end);
+    if (end == line)
+        return false;
+    record.addr = strtoul(p, &end, 0);
+    if (end == p)
+        return false;
+    p = skip_spaces(end);
+    if (is_type(p)) {
+        record.is_write = (*p == 'W');
+    } else if (*p && *p != '\r' && *p != '\n') {
+        record.writeback_addr = strtoul(p, &end, 0);
+        if (end == p)
+            return false;
+        record.has_writeback = true;
+    }
+    return true;
+}
+
+static TraceHeader::Kind text_kind(const string& line)
+{
+    const char* p = skip_spaces(skip_spaces(line.c_str()) + strcspn(line.c_str(), " \t"));
+    return is_type(p) ? TraceHeader::Kind::DRAM : TraceHeader::Kind::CPU;
+}
+
+// Like the readers of Trace, stops at the first empty line of a text trace
+static int convert(const char* in_fname, const char* out_fname, bool timed)
+{
+    unique_ptr<TraceSource> source(TraceSource::open(in_fname));
+    if (!source) {
+        cerr << "Bad trace file: " << in_fname << endl;
+        return 1;
+    }
+    istream in(source.get());
+    ofstream out(out_fname, ios::binary | ios::trunc);
+    if (!out.good()) {
+        cerr << "Cannot write " << out_fname << endl;
+        return 1;
+    }
+
+    TraceHeader header;
+    header.write(out);  // the record count is filled in at the end
+
+    TraceEncoder encoder;
+    TraceRecord record;
+    string line;
+    long line_num = 0;
+    while (getline(in, line)) {
+        line_num++;
+        if (line.empty() || line == "\r")
+            break;
+        if (!header.records)
+            header.kind = timed ? TraceHeader::Kind::TimedDRAM : text_kind(line);
+        if (!parse_line(line.c_str(), header.kind, record)) {
+            cerr << in_fname << ":" << line_num << ": bad trace line: " << line << endl;
+            return 1;
+        }
+        encoder.put(out, record);
+        header.records++;
+    }
+
+    out.seekp(0);
+    header.write(out);
+    if (!out.good()) {
+        cerr << "Cannot write " << out_fname << endl;
+        return 1;
+    }
+    const char* kind_name = header.kind == TraceHeader::Kind::CPU ? "CPU"
+        : header.kind == TraceHeader::Kind::DRAM ? "memory" : "timed memory";
+    printf("Converted %lu records (%s trace) to %s\n", (unsigned long)header.records,
+        kind_name, out_fname);
+    return 0;
+}
+
+// Like the readers of Trace, stops at the first empty line of a text trace
+static int index(const char* fname, long interval)
+{
+    unique_ptr<TraceSource> source(TraceSource::open(fname));
+    struct stat st;
+    if (!source || stat(fname, &st) || interval <= 0) {
+        cerr << "Bad trace file: " << fname << endl;
+        return 1;
+    }
+    istream in(source.get());
+
+    TraceIndex index;
+    index.interval = interval;
+    index.trace_size = st.st_size;
+
+    TraceHeader header;
+    bool binary = header.read(in);
+    if (!binary) {
+        in.clear();
+        source->rewind();
+    }
+    TraceDecoder decoder;
+    TraceHeader::Kind kind = header.kind;
+    TraceRecord record;
+    string line;
+    uint64_t insts = 0, records = 0;
+    while (true) {
+        TraceIndex::Entry entry;
+        entry.insts = insts;
+        entry.offset = source->tell();
+        entry.records = records;
+        entry.prev_addr = decoder.last_addr();
+        if (binary) {
+            if (records == header.records || !decoder.get(*source, record))
+                break;
+        } else {
+            if (!getline(in, line) || line.empty() || line == "\r")
+                break;
+            if (!records)
+                kind = text_kind(line);
+            if (!parse_line(line.c_str(), kind, record)) {
+                cerr << fname << ":" << records + 1 << ": bad trace line: " << line << endl;
+                return 1;
+            }
+        }
+        if (records % interval == 0)
+            index.entries.push_back(entry);
+        insts += TraceIndex::insts(record);
+        records++;
+    }
+
+    string out_fname = string(fname) + ".idx";
+    ofstream out(out_fname, ios::binary | ios::trunc);
+    index.write(out);
+    if (!out.good()) {
+        cerr << "Cannot write " << out_fname << endl;
+        return 1;
+    }
+    printf("Indexed %lu records (%lu instructions) of %s in %s\n", (unsigned long)records,
+        (unsigned long)insts, fname, out_fname.c_str());
+    return 0;
+}
+
+static void usage()
+{
+    printf("Usage: tracetool convert [--timed] <text trace> <binary trace>\n"
+           "       tracetool index <trace> [records between entries (default 100000)]\n");
+}
+
+int main(int argc, const char* argv[])
+{
+    if (argc == 4 && !strcmp(argv[1], "convert"))
+        return convert(argv[2], argv[3], false);
+    if (argc == 5 && !strcmp(argv[1], "convert") && !strcmp(argv[2], "--timed"))
+        return convert(argv[3], argv[4], true);
+    if (argc >= 3 && argc <= 4 && !strcmp(argv[1], "index"))
+        return index(argv[2], argc == 4 ? atol(argv[3]) : 100000);
+    usage();
+    return 1;
+}
@@ -0,0 +1,169 @@
+#include "TrafficGenerator.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+using namespace ramulator;
+
+static const char* prefix = "gen:";
+
+static const map<string, TrafficGenerator::Pattern> name_to_pattern = {
+    {"random", TrafficGenerator::Pattern::Random},
+    {"stream", TrafficGenerator::Pattern::Stream},
+    {"stride", TrafficGenerator::Pattern::Stride},
+    {"rowhit", TrafficGenerator::Pattern::RowHit},
+    {"conflict", TrafficGenerator::Pattern::Conflict},
+    {"hotspot", TrafficGenerator::Pattern::HotSpot},
+};
+
+bool TrafficGenerator::is_spec(const string& name)
+{
+    return name.compare(0, strlen(prefix), prefix) == 0;
+}
+
+TrafficGenerator::TrafficGenerator(const string& spec, const MemoryLayout& layout)
+    : layout(layout)
+{
+    // gen:<pattern>[,<option>=<value>]...
+    size_t start = strlen(prefix), end = spec.find(',', start);
+    string name = spec.substr(start, end - start);
+    if (!name_to_pattern.count(name)) {
+        cerr << "Unknown traffic pattern: " << name << endl;
+        exit(1);
+    }
+    pattern = name_to_pattern.at(name);
+    while (end != string::npos) {
+        start = end + 1;
+        end = spec.find(',', start);
+        string opt = spec.substr(start, end - start);
+        size_t eq = opt.find('=');
+        if (eq == string::npos) {
+            cerr << "Bad traffic option (expected <option>=<value>): " << opt << endl;
+            exit(1);
+        }
+        options[opt.substr(0, eq)] = opt.substr(eq + 1);
+    }
+
+    requests = option("requests", 100000l, 1000);
+    read_ratio = option("read_ratio", 0.8);
+    stride = option("stride", 4096l, 1024);
+    row_hit = option("row_hit", 0.5);
+    banks = option("banks", 1l, 1000);
+    hot_size = option("hot_size", 1l << 20, 1024);
+    hot_fraction = option("hot_fraction", 0.9);
+    rng.seed(option("seed", 0l, 1000));
+    for (auto& opt : options) {
+        cerr << "Unknown traffic option: " << opt.first << endl;
+        exit(1);
+    }
+
+    units = layout.capacity / layout.tx_bytes;
+    if ((pattern == Pattern::RowHit || pattern == Pattern::Conflict) && !layout.address_of) {
+        cerr << "Traffic pattern " << name << " needs the default address mapping" << endl;
+        exit(1);
+    }
+    if (requests <= 0 || stride <= 0 || banks <= 0 || hot_size <= 0) {
+        cerr << "Bad traffic option in " << spec << endl;
+        exit(1);
+    }
+
+    hot_units = max(1l, min(hot_size, layout.capacity) / layout.tx_bytes);
+    hot_base = random(units - hot_units + 1);
+    last = AddrVec(layout.sizes.size());
+    randomize(last, 0);
+    bank_vecs.resize(banks, AddrVec(layout.sizes.size()));
+    for (auto& vec : bank_vecs)
+        randomize(vec, 0);
+}
+
+// Takes (and removes) a decimal option; a K, M or G suffix multiplies it by
+// unit, unit^2 or unit^3
+long TrafficGenerator::option(const string& name, long value, long unit)
+{
+    auto it = options.find(name);
+    if (it == options.end())
+        return value;
+    const char* str = it->second.c_str();
+    char* end;
+    value = strtol(str, &end, 10);
+    bool ok = end != str;
+    switch (*end) {
+        case 'g': case 'G': value *= unit;  // fall through
+        case 'm': case 'M': value *= unit;  // fall through
+        case 'k': case 'K': value *= unit; end++; break;
+    }
+    if (!ok || *end) {
+        cerr << "Bad value of traffic option " << name << ": " << it->second << endl;
+        exit(1);
+    }
+    options.erase(it);
+    return value;
+}
+
+// Takes (and removes) an option that is a fraction, from 0 to 1
+double TrafficGenerator::option(const string& name, double value)
+{
+    auto it = options.find(name);
+    if (it == options.end())
+        return value;
+    const char* str = it->second.c_str();
+    char* end;
+    value = strtod(str, &end);
+    if (end == str || *end || !(value >= 0.0 && value <= 1.0)) {
+        cerr << "Bad value of traffic option " << name << " (expected 0 to 1): " << it->second << endl;
+        exit(1);
+    }
+    options.erase(it);
+    return value;
+}
+
+void TrafficGenerator::randomize(AddrVec& vec, int from_level)
+{
+    for (int lev = from_level; lev < vec.size(); lev++)
+        vec[lev] = random(layout.sizes[lev]);
+}
+
+long TrafficGenerator::next_address()
+{
+    switch (pattern) {
+        case Pattern::Random:
+            return random(units) * layout.tx_bytes;
+        case Pattern::Stream:
+            return sent % units * layout.tx_bytes;
+        case Pattern::Stride:
+            return sent * stride % layout.capacity / layout.tx_bytes * layout.tx_bytes;
+        case Pattern::RowHit: {
+            // a new column of the same row, or a new location altogether
+            int column = last.size() - 1;
+            randomize(last, chance() < row_hit ? column : 0);
+            return layout.address_of(last);
+        }
+        case Pattern::Conflict: {
+            AddrVec& vec = bank_vecs[sent % banks];
+            int row = vec[layout.row_level];
+            if (layout.sizes[layout.row_level] > 1)
+                while (vec[layout.row_level] == row)
+                    randomize(vec, layout.row_level);
+            return layout.address_of(vec);
+        }
+        case Pattern::HotSpot:
+            if (chance() < hot_fraction)
+                return (hot_base + random(hot_units)) * layout.tx_bytes;
+            return random(units) * layout.tx_bytes;
+        default:
+            assert(false);
+            return 0;
+    }
+}
+
+bool TrafficGenerator::get_request(long& req_addr, Request::Type& req_type)
+{
+    if (sent == requests)
+        return false;
+    req_addr = next_address();
+    req_type = chance() < read_ratio ? Request::Type::READ : Request::Type::WRITE;
+    sent++;
+    return true;
+}
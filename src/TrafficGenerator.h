@@ -0,0 +1,88 @@
+#ifndef __TRAFFICGENERATOR_H
+#define __TRAFFICGENERATOR_H
+
+#include "Request.h"
+#include <functional>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace ramulator
+{
+
+// What a traffic generator needs to know about the memory it drives
+struct MemoryLayout
+{
+    long capacity = 0;          // bytes
+    int tx_bytes = 64;          // bytes per request
+    std::vector<int> sizes;     // entries per level of an address vector
+    int row_level = 0;          // the levels above it select a bank
+    // The address that maps to an address vector, if the mapping can be
+    // inverted (not for mapping files)
+    std::function<long(const AddrVec&)> address_of;
+};
+
+// Synthetic memory requests for DRAM trace mode, made in-process instead of
+// read from a trace file. A generator is named on the command line in place
+// of the trace, as gen:<pattern>[,<option>=<value>]..., e.g.,
+//
+//   gen:random,requests=1M,read_ratio=0.8,seed=1
+//
+// Patterns (and their own options):
+//   random    uniformly random addresses
+//   stream    consecutive addresses
+//   stride    addresses stride bytes apart (stride=4096)
+//   rowhit    the row of the last request again with probability row_hit,
+//             or else a random one (row_hit=0.5)
+//   conflict  random rows of banks banks in turn (banks=1), so that
+//             nearly every request is a row conflict
+//   hotspot   a random address in a hot_size byte region with probability
+//             hot_fraction, or else anywhere (hot_size=1M, hot_fraction=0.9)
+// Options of every pattern: requests=100K, read_ratio=0.8, seed=0. Values
+// are decimal; counts take K, M and G suffixes (powers of 1000), and so do
+// sizes (of 1024). Ratios, fractions and probabilities are from 0 to 1.
+class TrafficGenerator
+{
+public:
+    enum class Pattern {Random, Stream, Stride, RowHit, Conflict, HotSpot, MAX};
+
+    static bool is_spec(const std::string& name);
+
+    TrafficGenerator(const std::string& spec, const MemoryLayout& layout);
+
+    // Returns false after the last request, like Trace::get_dramtrace_request
+    bool get_request(long& req_addr, Request::Type& req_type);
+
+private:
+    MemoryLayout layout;
+    Pattern pattern;
+    std::map<std::string, std::string> options;
+
+    long requests;
+    double read_ratio;
+    long stride;
+    double row_hit;
+    int banks;
+    long hot_size;
+    double hot_fraction;
+
+    std::mt19937_64 rng;
+    long sent = 0;
+    long units;                     // requests that fit in the memory
+    long hot_units;                 // hot_size, in requests
+    long hot_base = 0;              // in requests
+    AddrVec last;                   // rowhit: the last request
+    std::vector<AddrVec> bank_vecs; // conflict: the banks and their last rows
+
+    long option(const std::string& name, long value, long unit);
+    double option(const std::string& name, double value);
+    long random(long n) {return long(rng() % (unsigned long)n);}
+    double chance() {return (rng() >> 11) * (1.0 / (1ul << 53));}
+    void randomize(AddrVec& vec, int from_level);
+    long next_address();
+};
+
+} /*namespace ramulator*/
+
+#endif /*__TRAFFICGENERATOR_H*/
@@ -0,0 +1,117 @@
+#ifndef __WORKERPOOL_H
+#define __WORKERPOOL_H
+
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace ramulator
+{
+
+// A fixed set of threads that run job(i) for every i in [0, jobs) each time
+// run() is called. Jobs are statically assigned to threads (i % threads), and
+// the calling thread takes part, so run() acts as a barrier: it only returns
+// once every job of this round has finished. Waiting threads spin briefly and
+// then block, so a pool larger than the host's cores still makes progress.
+class WorkerPool
+{
+public:
+    WorkerPool(int threads, int jobs, function<void(int)> job)
+        : threads(threads), jobs(jobs), job(job), remaining(0), round(0), stop(false)
+    {
+        assert(threads > 1 && jobs > 0);
+        for (int t = 1; t < threads; t++)
+            workers.emplace_back(&WorkerPool::work, this, t);
+    }
+
+    ~WorkerPool()
+    {
+        stop = true;
+        next_round();
+        for (auto& worker : workers)
+            worker.join();
+    }
+
+    void run()
+    {
+        remaining.store(threads - 1, memory_order_relaxed);
+        next_round();
+        run_jobs(0);
+        wait_until([this] { return remaining.load(memory_order_acquire) == 0; }, finished);
+    }
+
+private:
+    // busy-wait this many times, then yield the core this many times before
+    // blocking on a condition variable
+    static const int max_spins = 1024;
+    static const int max_yields = 16;
+
+    int threads;
+    int jobs;
+    function<void(int)> job;
+    vector<thread> workers;
+
+    atomic<int> remaining;  // workers that have not finished the current round
+    atomic<long> round;     // bumped once per call of run()
+    atomic<bool> stop;
+
+    mutex lock;
+    condition_variable started;   // a new round was posted
+    condition_variable finished;  // the last worker finished the round
+
+    void run_jobs(int t)
+    {
+        for (int i = t; i < jobs; i += threads)
+            job(i);
+    }
+
+    // The shared state is changed under the lock before notifying, so a
+    // thread that checks it under the lock cannot miss the wakeup.
+    void next_round()
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            round.fetch_add(1, memory_order_release);
+        }
+        started.notify_all();
+    }
+
+    template <class Ready>
+    void wait_until(Ready ready, condition_variable& cv)
+    {
+        for (int spins = 0; spins < max_spins + max_yields; spins++) {
+            if (ready())
+                return;
+            if (spins >= max_spins)
+                this_thread::yield();
+        }
+        unique_lock<mutex> guard(lock);
+        cv.wait(guard, ready);
+    }
+
+    void work(int t)
+    {
+        long done = 0;
+        while (true) {
+            wait_until([this, done] { return round.load(memory_order_acquire) != done; }, started);
+            if (stop)
+                return;
+            done++;
+            run_jobs(t);
+            if (remaining.fetch_sub(1, memory_order_acq_rel) == 1) {
+                { lock_guard<mutex> guard(lock); }
+                finished.notify_one();
+            }
+        }
+    }
+};
+
+} /*namespace ramulator*/
+
+#endif /*__WORKERPOOL_H*/
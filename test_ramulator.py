@@ -5,8 +5,9 @@
 # in terms of simulation accuracy (i.e., cycles to complete a given trace), simulation speed, and system memory usage.
 
 import subprocess
-import sys, tempfile, psutil, time, random
-import gzip, shutil
+import sys, tempfile, psutil, time
+import csv, json, struct
+import shutil
 import colorama
 from os import path
 
@@ -45,8 +46,9 @@ def convert_str_to_number(x):
             num = float(x[:-1]) * num_map.get(x[-1].upper(), 1)
     return int(num)
 
-# generate the synthetic trace file file if it does not exist
-def generateSyntheticTrace(trace_name):
+# Ramulator generates synthetic traffic itself (see src/TrafficGenerator.h),
+# so a synthetic trace name only translates to a generator spec
+def syntheticTrafficSpec(trace_name):
     
     trace_options = trace_name.split('-')
     if len(trace_options) != 3:
@@ -63,54 +65,7 @@ def generateSyntheticTrace(trace_name):
     except:
         invalidTraceFormat(trace_name)
 
-    trace_filename = f'./{trace_type}_{trace_options[1]}_{trace_options[2]}.trace'
-
-    if path.exists(trace_filename):
-        return trace_filename # no need to regenerate the trace if it already exists
-
-    print(f"Generating '{trace_type}' synthetic trace: {trace_filename} with {num_reqs} memory requests")
-
-    trace_file = open(trace_filename, 'w')
-
-    if trace_type == 'random':
-        s = 64
-        bits = 31
-
-        l = int(s/64)
-        b = int(num_reqs/l)
-
-        for i in range(b):
-            base = random.getrandbits(bits) & 0xffffffffffc0
-            r = bool(random.random() < read_ratio)
-            for j in range(l):
-                trace_file.write('0x%x %s\n' % (base+j*64, 'R' if r else 'W'))
-    
-    if trace_type == 'stream':
-        r = int(num_reqs * read_ratio)
-        w = num_reqs - r
-        for i in range(r):
-            trace_file.write('0x%x %s\n' % (i*64, 'R'))
-        for i in range(w):
-            trace_file.write('0x%x %s\n' % ((r+i)*64, 'W'))
-
-    trace_file.close()
-
-    return trace_filename
-
-
-def extractTrace(trace_path):
-    
-    uncompressed_path = trace_path.replace('.gz', '')
-
-    if path.exists(uncompressed_path):
-        return uncompressed_path # no need to extract if the .gz is already extracted
-
-    print(f"Extracting {trace_path}")
-    with gzip.open(trace_path, 'rb') as compressed_file:
-        with open(uncompressed_path, 'wb') as uncompressed_file:
-            shutil.copyfileobj(compressed_file, uncompressed_file)
-
-    return uncompressed_path
+    return f'gen:{trace_type},requests={num_reqs},read_ratio={read_ratio}'
 
 
 def get_stat(stat_file, stat_name):
@@ -158,6 +113,125 @@ def compareAgainstGolden(stats_filename):
 
 
 
+# Cores running the same trace must send the same requests. Each core decodes
+# its own trace, so this catches decoder state that leaks between cores.
+def checkIdenticalCores(config, trace_path, num_cores=4):
+    stats_filename = 'identical_cores.stat'
+    args = [RAMULATOR_BIN, config, '--mode=cpu', '--stats', stats_filename] + [trace_path]*num_cores
+    print(f"Starting simulation: {' '.join(args)}")
+    subprocess.run(args, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+    stats_file = open(stats_filename, 'r')
+    ok = True
+    for stat in ['read_requests_core_', 'write_requests_core_', 'cpu_instructions_core_']:
+        counts = [get_stat(stats_file, f'ramulator.{stat}{core} ') for core in range(num_cores)]
+        if None in counts or len(set(counts)) != 1:
+            print(f"Per-core '{stat}N' values differ across cores running the same trace: {counts}")
+            ok = False
+    stats_file.close()
+    return ok
+
+
+# With write_merging, a write to a queued cache line is merged into the queued
+# write and a read of the line is forwarded from it, whatever the offset of
+# either address within the line. Without it, only a read of the exact address
+# of a queued write is forwarded. The reads ahead of them keep the writes
+# waiting in the write queue.
+def checkWriteMerging(config):
+    with open('write_merging.trace', 'w') as trace:
+        for i in range(16):
+            trace.write(f'{hex(0x10000000 + i*0x100000)} R\n')
+        trace.write('0x1000 W\n0x1008 W\n0x1030 R\n0x1008 R\n')
+    ok = True
+    for merging, expected in [('on', (1, 2)), ('off', (0, 1))]:
+        with open(config) as f, open('write_merging.cfg', 'w') as cfg:
+            cfg.write(f.read() + f'\n write_merging = {merging}\n')
+        stats_filename = 'write_merging.stat'
+        args = [RAMULATOR_BIN, 'write_merging.cfg', '--mode=dram', '--stats', stats_filename, 'write_merging.trace']
+        print(f"Starting simulation: {' '.join(args)}")
+        subprocess.run(args, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+
+        stats_file = open(stats_filename, 'r')
+        merged = get_stat(stats_file, 'ramulator.merged_writes_0 ')
+        forwarded = get_stat(stats_file, 'ramulator.forwarded_reads_0 ')
+        stats_file.close()
+        if (merged, forwarded) != expected:
+            print(f"With write_merging = {merging}, expected {expected[0]} merged writes and {expected[1]} forwarded reads, got {merged} and {forwarded}")
+            ok = False
+    return ok
+
+
+# A bad generator option must stop the run with an error instead of
+# simulating forever or with a wrapped value
+def checkBadTrafficOptions(config):
+    ok = True
+    for spec in ['gen:random,requests=-1', 'gen:random,requests=0', 'gen:stride,stride=-4K',
+                 'gen:random,read_ratio=1.5', 'gen:random,seed=12x']:
+        args = [RAMULATOR_BIN, config, '--mode=dram', '--stats', 'bad_traffic.stat', spec]
+        print(f"Starting simulation: {' '.join(args)}")
+        try:
+            returncode = subprocess.run(args, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL, timeout=60).returncode
+        except subprocess.TimeoutExpired:
+            returncode = None
+        if returncode != 1:
+            print(f"Expected {spec} to be rejected with exit status 1, got {returncode}")
+            ok = False
+    return ok
+
+
+# The values of every stats format, in order, as [name, value, elements]
+def read_stats(stats_filename, stats_format):
+    if stats_format == 'text':
+        stats = []
+        for l in open(stats_filename):
+            name, value = l.split()[:2]
+            if name.startswith('['):
+                stats[-1][2].append(float(value))
+            else:
+                stats.append([name, float(value), []])
+        return stats
+    if stats_format == 'json':
+        return [[s['name'], s['value'], s.get('elements', [])] for s in json.load(open(stats_filename))['stats']]
+    if stats_format == 'csv':
+        return [[r['name'], float(r['value']), [float(e) for e in r['elements'].split()]]
+                for r in csv.DictReader(open(stats_filename, newline=''))]
+    data = open(stats_filename, 'rb').read()
+    magic, version, num_stats, num_elements, _ = struct.unpack_from('<8s4I', data)
+    values = struct.unpack_from(f'<{num_stats}d', data, 24)
+    elements = struct.unpack_from(f'<{num_elements}d', data, 24 + 8*num_stats)
+    counts = struct.unpack_from(f'<{num_stats}I', data, 24 + 8*(num_stats + num_elements))
+    names = data[24 + 8*(num_stats + num_elements) + 4*num_stats:].split(b'\0')[:num_stats]
+    stats, e = [], 0
+    for name, value, count in zip(names, values, counts):
+        stats.append([name.decode(), value, list(elements[e:e + count])])
+        e += count
+    return stats
+
+
+# Every --stats-format must carry the same stats as the text file, which
+# rounds them to a few decimals
+def checkStatsFormats(config, trace_path):
+    stats = {}
+    for stats_format in ['text', 'json', 'csv', 'binary']:
+        stats_filename = f'stats_format.{stats_format}'
+        args = [RAMULATOR_BIN, config, '--mode=dram', '--stats', stats_filename, '--stats-format', stats_format, trace_path]
+        print(f"Starting simulation: {' '.join(args)}")
+        subprocess.run(args, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+        stats[stats_format] = read_stats(stats_filename, stats_format)
+
+    close = lambda a, b: abs(a - b) <= 0.05 + 1e-9*abs(b)
+    ok = True
+    for stats_format in ['json', 'csv', 'binary']:
+        text, other = stats['text'], stats[stats_format]
+        same = len(text) == len(other) and all(
+            t[0] == o[0] and close(t[1], o[1]) and len(t[2]) == len(o[2]) and all(map(close, t[2], o[2]))
+            for t, o in zip(text, other))
+        if not same:
+            print(f"The {stats_format} stats differ from the text stats")
+            ok = False
+    return ok
+
+
 def main():
     blackhole = open('/dev/null', 'w')
 
@@ -173,17 +247,16 @@ def main():
         # Simulate each trace with each Ramulator config
 
         mode = '--mode=cpu'
+        trace_name = path.basename(trace_path).replace('.gz', '')
 
         if isSyntheticTrace(trace_path):
-            trace_path = generateSyntheticTrace(trace_path)
+            trace_name = trace_path.replace('-', '_')
+            trace_path = syntheticTrafficSpec(trace_path)
             mode = '--mode=dram' # synthetic traces are for --mode=dram
-        
-        if ".gz" in trace_path:
-            trace_path = extractTrace(trace_path)
+        # compressed traces (.gz) are read by Ramulator directly
 
         for config in configs:
 
-            trace_name = path.basename(trace_path).replace('.gz', '')
             dram_type = path.basename(config).replace('-config', '').replace('.cfg', '')
             stats_filename = f"{trace_name.replace('.trace', '')}_{dram_type}.stat"
             
@@ -219,6 +292,18 @@ def main():
 
             print(f"Stat Consistency: {ok_str if stats_ok else fail_str}, Runtime: {ok_str if runtime_ok else fail_str}, Memory Usage: {ok_str if mem_usage_ok else fail_str}")
 
+    cores_ok = checkIdenticalCores(configs[0], './cputraces/403.gcc.gz')
+    print(f"Identical Cores: {ok_str if cores_ok else fail_str}")
+
+    formats_ok = checkStatsFormats(configs[0], syntheticTrafficSpec('random-100k-0.8'))
+    print(f"Stats Formats: {ok_str if formats_ok else fail_str}")
+
+    merging_ok = checkWriteMerging(configs[0])
+    print(f"Write Merging: {ok_str if merging_ok else fail_str}")
+
+    options_ok = checkBadTrafficOptions(configs[0])
+    print(f"Bad Traffic Options: {ok_str if options_ok else fail_str}")
+
     blackhole.close()
 
 